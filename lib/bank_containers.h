@@ -18,6 +18,22 @@
 #include <TTree.h>
 #include "reader.h"
 
+/** Run and event numbers of each event. */
+class RUN_Config {
+private:
+    int nrows;
+    int set_nrows(int in_nrows);
+public:
+    std::vector<Int_t> *run;   TBranch *b_run;   // run number.
+    std::vector<Int_t> *event; TBranch *b_event; // event number, unique within the run.
+    RUN_Config();
+    RUN_Config(TTree *t);
+    int get_nrows();
+    int link_branches(TTree *t);
+    int fill(hipo::bank b);
+    int get_entries(TTree *t, int idx);
+};
+
 /** Reconstructed particle "final" information. */
 class REC_Particle {
 private:
@@ -14,14 +14,66 @@
 #ifndef CONSTANTS
 #define CONSTANTS
 
-#include <map>
-
 // Physics constants.
 #define SPEEDOFLIGHT 29.9792458
 
-// PID arrays.
-extern const std::map<int, double> MASS;
-extern const std::map<int, int> PID_QA;
+// PID properties table. Masses in GeV, and qa is the particle's index in the PID quality assessment
+//     matrix (-1 if not assessed). Entry 0 is returned for any unknown PID.
+typedef struct {
+    int    pid;
+    double mass;
+    int    charge;
+    int    qa;
+} pid_props;
+
+#define PID_TABLE_SIZE 19
+constexpr pid_props PID_TABLE[PID_TABLE_SIZE] = {
+        {         0, -1.,       0, -1}, // unidentified particle.
+        {        45, -1.,       0, -1}, // unidentified particle.
+        {        11,  0.000051,-1,  0}, // electron.
+        {       -11,  0.000051, 1,  0}, // positron.
+        {        13,  0.105658,-1, -1}, // negative muon.
+        {       -13,  0.105658, 1, -1}, // positive muon.
+        {        22,  0.,       0,  5}, // photon.
+        {       111,  0.134977, 0, -1}, // neutral pion.
+        {       211,  0.139570, 1,  1}, // positive pion.
+        {      -211,  0.139570,-1,  1}, // negative pion.
+        {       311,  0.497614, 0, -1}, // neutral kaon.
+        {       321,  0.493677, 1,  2}, // positive kaon.
+        {      -321,  0.493677,-1,  2}, // negative kaon.
+        {       221,  0.548953, 0, -1}, // eta.
+        {       223,  0.782650, 0, -1}, // omega.
+        {      2112,  0.939565, 0,  4}, // neutron.
+        {      2212,  0.938272, 1,  3}, // proton.
+        {     -2212,  0.938272,-1,  3}, // antiproton.
+        {1000010020,  1.875,    1, -1}  // deuterium.
+};
+
+// PID to PID_TABLE index, through a collision-free modulo hash. If a particle is added to PID_TABLE,
+//     PID_HASH_SIZE might need to be changed for the hash to remain collision-free.
+#define PID_HASH_SIZE 41
+constexpr int PID_SLOT[PID_HASH_SIZE] = {
+         0,  0, 17,  0,  1,  0,  8, 12,  0,  0,  0,  2,
+        18,  4,  0,  0, 13,  0, 14,  0,  0, 15,  6,  0,
+        10,  0,  0,  0,  5,  7,  3,  0,  0,  0, 11,  9,
+         0,  0,  0, 16,  0
+};
+
+constexpr int pid_hash(int pid) {
+    return ((pid % PID_HASH_SIZE) + PID_HASH_SIZE) % PID_HASH_SIZE;
+}
+constexpr int pid_idx(int pid) {
+    return PID_TABLE[PID_SLOT[pid_hash(pid)]].pid == pid ? PID_SLOT[pid_hash(pid)] : 0;
+}
+constexpr double pid_mass  (int pid) {return PID_TABLE[pid_idx(pid)].mass;}
+constexpr int    pid_charge(int pid) {return PID_TABLE[pid_idx(pid)].charge;}
+constexpr int    pid_qa_idx(int pid) {return PID_TABLE[pid_idx(pid)].qa;}
+
+// Check that every particle in PID_TABLE is found by pid_idx().
+constexpr bool pid_table_check(int i) {
+    return i == PID_TABLE_SIZE || (pid_idx(PID_TABLE[i].pid) == i && pid_table_check(i+1));
+}
+static_assert(pid_table_check(0), "PID_SLOT is out of sync with PID_TABLE.");
 
 // Particle cut array.
 #define PART_LIST_SIZE 5
@@ -67,6 +119,17 @@ extern const int    STD_PX[STDPLT_LIST_SIZE];
 extern const int    STD_VX[STDPLT_LIST_SIZE][2];
 extern const double STD_RX[STDPLT_LIST_SIZE][2][2];
 extern const long   STD_BX[STDPLT_LIST_SIZE][2];
+#define PLT_MAXMB  4096    // Memory budget for draw_plots' histograms, in MB.
+#define DRAW_CHUNK 1000000 // Ntuple entries per draw_plots fill chunk.
+#define DRAW_BLOCK 4096    // Rows per draw_plots cut evaluation block.
+#define DRAW_LINELEN 1022  // Max characters in a line of a draw_plots config file.
+#define DRAW_INFILE "../root_io/ntuples.root" // Default draw_plots input. NOTE. This path sucks.
+
+// Tree of the entries and events read by draw_plots from each run.
+#define S_RUNCOUNTS "run_counts"
+#define R_NENTRIES  "nentries"
+#define R_NEVENTS   "nevents"
+#define R_NSELECTED "nselected"
 
 // All variables.
 #define S_PARTICLE "particle"
@@ -84,6 +147,9 @@ extern const char * S_VAR_LIST[VAR_LIST_SIZE];
 #define S_BEAME   "E_{beam}"
 #define R_BEAME   "beam_energy"
 #define A_BEAME   2
+// 64-bit (run, event) key, stored in a separate Long64_t branch so that event numbers stay exact.
+#define R_EVNKEY    "event_key"
+#define EVNKEY_BITS 40 // Bits used by the event number in a key. The run number takes 23.
 
 // Particle.
 #define S_PID    "pid"
@@ -203,14 +269,22 @@ extern const char * SIDIS_LIST[SIDIS_LIST_SIZE];
 #define ECIN_IDX   1   // ECIN idx in Sampling fraction arrays.
 #define ECOU_IDX   2   // ECOU idx in Sampling fraction arrays.
 #define CALS_IDX   3   // CALs idx in Sampling fraction arrays.
+#define SF_NCALS   4   // # of calorimeter entries in Sampling fraction arrays.
 #define SF_PMIN    1.0 // GeV
 #define SF_PMAX    9.0 // GeV
 #define SF_PSTEP   0.4 // GeV
+#define SF_NPBINS  ((int) ((SF_PMAX - SF_PMIN)/SF_PSTEP)) // # of momentum bins.
+#define SF_PSUBDIV 8   // # of 2D SF histogram momentum bins per momentum bin.
 #define SF_NPARAMS 4
 #define SF_CHI2CONFORMITY 2 // NOTE. This is a source of systematic error!
-extern const char * CALNAME[4]; // Calorimeters names.
-extern const char * SFARR2D[4]; // Sampling Fraction (SF) 2D arr names.
-extern const char * SFARR1D[4]; // SF 1D arr names.
+#define SF_FAST_MINN   20   // Min entries in a momentum bin for the fast SF fits.
+#define SF_FAST_NSIGMA 2.   // Truncation of the fast SF fits moments, in sigmas.
+#define SF_FAST_NITER  3    // Truncation iterations of the fast SF fits moments.
+#define SF_MOM_SCALE   1e6  // Fixed-point scale of the streaming E/p moments.
+#define SF_CHECK_NEVN  1000000 // Default # of events per run between precision checks.
+extern const char * CALNAME[SF_NCALS]; // Calorimeters names.
+extern const char * SFARR2D[SF_NCALS]; // Sampling Fraction (SF) 2D arr names.
+extern const char * SFARR1D[SF_NCALS]; // SF 1D arr names.
 extern const double PLIMITSARR[SF_NPARAMS][2]; // Momentum limits for 1D SF fits.
 
 // Run constants (TODO. these should be in a map or taken from clas12mon.)
@@ -21,9 +21,26 @@ int make_ntuples_usage();
 int make_ntuples_handle_args_err(int errcode, char **in_filename, int run_no);
 int make_ntuples_err(int errcode, char **in_filename);
 int extractsf_usage();
-int extractsf_handle_args_err(int errcode, char **in_filename);
-int extractsf_err(int errcode, char **in_filename);
+int extractsf_handle_args_err(int errcode, char **in_files, int *run_nos, int nfiles,
+                              char **state_file, char **seed_file);
+int extractsf_err(int errcode, char **in_files, int *run_nos, int nfiles, int bad_file,
+                  char **state_file, char **seed_file);
+int merge_sf_usage();
+int merge_sf_handle_args_err(int errcode, char **in_files, int nfiles, char **out_file,
+                             char **seed_file);
+int merge_sf_err(int errcode, char **in_files, int nfiles, int bad_file, char **out_file,
+                 char **seed_file);
 int hipo2root_usage();
 int hipo2root_handle_args_err(int errcode, char **in_filename);
+int audit_kinematics_usage();
+int audit_kinematics_handle_args_err(int errcode);
+int audit_kinematics_err(int errcode);
+int audit_selection_usage();
+int audit_selection_handle_args_err(int errcode);
+int audit_selection_err(int errcode);
+int draw_plots_usage();
+int draw_plots_handle_args_err(int errcode, char **in_files, int nfiles, char **config_file);
+int draw_plots_err(int errcode, char **in_files, int nfiles, int bad_file, char **config_file,
+                   int bad_line);
 
 #endif
@@ -0,0 +1,70 @@
+// CLAS12 RG-E Analyser.
+// Copyright (C) 2022 Bruno Benkel
+//
+// This program is free software: you can redistribute it and/or modify it under the terms of the
+// GNU Lesser General Public License as published by the Free Software Foundation, either version 3
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+// even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// Lesser General Public License for more details.
+//
+// You can see a copy of the GNU Lesser Public License under the LICENSE file.
+
+#ifndef EXPRESSION
+#define EXPRESSION
+
+#include <stdbool.h>
+#include <vector>
+
+// Expressions over named columns, such as `p > 1 && abs(vz) < 5` or `sqrt(vx*vx + vy*vy)`. They're
+//     compiled once into postfix bytecode, and each instruction is then run over a whole chunk of
+//     rows at a time, so that evaluating them costs a few tight loops per chunk instead of any work
+//     per row. Supported are:
+//     * numbers and column names,
+//     * arithmetic: + - * / and unary -,
+//     * comparisons: < <= > >= == !=,
+//     * logic: && || !,
+//     * functions: abs, sqrt, exp, log, sin, cos, tan, atan2, pow, min, and max.
+//     Arithmetic and comparisons take numbers, and logic takes the result of comparisons or other
+//     logic, so that type errors are caught when compiling.
+
+#define EXPR_CHUNK 256 // Rows evaluated by each pass of an instruction.
+#define EXPR_MAXDEPTH 32 // Largest number of values an expression can keep on its stack.
+
+// Value types.
+#define EXPR_NUM  0
+#define EXPR_BOOL 1
+
+// Instructions.
+enum expr_op {
+    EXPR_COL, EXPR_CONST,
+    EXPR_ADD, EXPR_SUB, EXPR_MUL, EXPR_DIV, EXPR_NEG,
+    EXPR_LT, EXPR_LE, EXPR_GT, EXPR_GE, EXPR_EQ, EXPR_NE,
+    EXPR_AND, EXPR_OR, EXPR_NOT,
+    EXPR_ABS, EXPR_SQRT, EXPR_EXP, EXPR_LOG, EXPR_SIN, EXPR_COS, EXPR_TAN,
+    EXPR_ATAN2, EXPR_POW, EXPR_MIN, EXPR_MAX
+};
+
+// One instruction. col is the column read by EXPR_COL, and value the constant pushed by
+//     EXPR_CONST.
+typedef struct {
+    expr_op op;
+    int     col;
+    float   value;
+} expr_instr;
+
+// Compiled expression. depth is the largest number of values it keeps on its stack, up to
+//     EXPR_MAXDEPTH.
+typedef struct {
+    std::vector<expr_instr> code;
+    int                     type;
+    int                     depth;
+} expression;
+
+int compile_expression(const char * text, const char * names[], int nnames, expression * e);
+int expression_columns(const expression * e, bool use[], int ncols);
+int eval_expression(const expression * e, const float * const cols[], long n, float * out,
+                    std::vector<float> * scratch);
+
+#endif
@@ -22,11 +22,19 @@
 
 #include "file_handler.h"
 
-int make_ntuples_handle_args(int argc, char ** argv, bool * debug, int * nevents, 
-                             char ** input_file, int * run_no, double * beam_energy);
+int make_ntuples_handle_args(int argc, char ** argv, bool * debug, long * nevents,
+                             char ** input_file, int * run_no, double * beam_energy, bool * fused);
 int extractsf_handle_args(int argc, char ** argv, bool * use_fmt, int * nevents,
-                          char ** input_file, int * run_no);
+                          char *** in_files, int ** run_nos, int * nfiles, int * nthreads,
+                          bool * fast_fit, bool * cmp_fits, char ** state_file, int * period_no,
+                          double * precision, long * check_nevn, char ** seed_file);
+int merge_sf_handle_args(int argc, char ** argv, int * nthreads, bool * fast_fit, bool * cmp_fits,
+                         char ** out_file, char ** seed_file, char *** in_files, int * nfiles);
 int hipo2root_handle_args(int argc, char ** argv, char ** input_file, int * run_no);
+int audit_kinematics_handle_args(int argc, char ** argv, int * nevents);
+int audit_selection_handle_args(int argc, char ** argv, int * nruns, long long * nevents);
+int draw_plots_handle_args(int argc, char ** argv, int * nthreads, bool * all_cols,
+                           bool * per_row, char ** config_file, char *** in_files, int * nfiles);
 
 int check_root_filename(char * input_file);
 int handle_root_filename(char * input_file, int * run_no);
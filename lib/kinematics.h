@@ -0,0 +1,144 @@
+// CLAS12 RG-E Analyser.
+// Copyright (C) 2022 Bruno Benkel
+//
+// This program is free software: you can redistribute it and/or modify it under the terms of the
+// GNU Lesser General Public License as published by the Free Software Foundation, either version 3
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+// even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// Lesser General Public License for more details.
+//
+// You can see a copy of the GNU Lesser Public License under the LICENSE file.
+
+#ifndef KINEMATICS
+#define KINEMATICS
+
+#include <algorithm>
+#include <cmath>
+
+#include "constants.h"
+
+// Kinematics templated over the scalar type, so that each can be evaluated in float or double.
+//     `particle.c` evaluates all of them in double. See `audit_kinematics.c` for a comparison
+//     between both precisions.
+
+// === VECTOR FUNCTIONS ============================================================================
+// Pass from radians to degrees.
+template <typename T> T to_deg(T radians) {
+    return radians * (T) (180.0 / M_PI);
+}
+
+// Compute a 2D vector's magnitude from its components.
+template <typename T> T calc_magnitude(T x, T y) {
+    return std::sqrt(x*x + y*y);
+}
+
+// Compute a 3D vector's magnitude from its components.
+template <typename T> T calc_magnitude(T x, T y, T z) {
+    return std::sqrt(x*x + y*y + z*z);
+}
+
+// Get angle between two vectors.
+template <typename T> T calc_angle(T x1, T y1, T z1, T x2, T y2, T z2) {
+    return std::acos((x1*x2 + y1*y2 + z1*z2)/(calc_magnitude(x1,y1,z1) * calc_magnitude(x2,y2,z2)));
+}
+
+// Rotate a vector around the y axis by theta.
+template <typename T> void rotate_y(T *x, T *z, T th) {
+    T x_prev = *x;
+    T z_prev = *z;
+    *x =  x_prev*std::cos(th) + z_prev*std::sin(th);
+    *z = -x_prev*std::sin(th) + z_prev*std::cos(th);
+}
+
+// Rotate a vector around the z axis by theta.
+template <typename T> void rotate_z(T *x, T *y, T th) {
+    T x_prev = *x;
+    T y_prev = *y;
+    *x = x_prev*std::cos(th) - y_prev*std::sin(th);
+    *y = x_prev*std::sin(th) + y_prev*std::cos(th);
+}
+
+// === LAB FRAME FUNCTIONS =========================================================================
+// Calculate theta angle in the lab frame from momentum components.
+template <typename T> T calc_theta_lab(T px, T py, T pz) {
+    return px == 0 && py == 0 && pz == 0 ? 0 : std::atan2(calc_magnitude(px, py), pz);
+}
+
+// Calculate phi angle in the lab frame from momentum components.
+template <typename T> T calc_phi_lab(T px, T py) {
+    return std::atan2(py, px);
+}
+
+// === DIS FUNCTIONS ===============================================================================
+// Calculate nu from beam energy and scattered electron momentum.
+template <typename T> T calc_nu(T bE, T p) {
+    return bE - p;
+}
+
+// Calculate Q^2 from beam energy, scattered electron momentum, and its theta angle.
+template <typename T> T calc_Q2(T bE, T p, T theta) {
+    T s = std::sin(theta/2);
+    return 4 * bE * p * s*s;
+}
+
+// Calculate x_bjorken from Q^2 and nu.
+template <typename T> T calc_Xb(T Q2, T nu) {
+    return Q2 / (2 * (T) pid_mass(2212) * nu);
+}
+
+// Calculate the squared invariant mass of the electron-nucleon interaction from Q^2 and nu. NOTE.
+//     The last two terms nearly cancel each other at high x_bjorken.
+template <typename T> T calc_W2(T Q2, T nu) {
+    T m_p = pid_mass(2212);
+    return m_p*m_p + 2*m_p*nu - Q2;
+}
+
+// Compute the rotation that takes a vector to the virtual photon frame, where the photon momentum q
+//     lies along z. This is a rotation around z by phi_z = pi - atan2(qy, qx), followed by a rotation
+//     around y by the angle between q and the z axis.
+template <typename T> void calc_photon_rotation(T qx, T qy, T qz, T *cos_phi_z, T *sin_phi_z,
+                                                T *cos_phi_y, T *sin_phi_y) {
+    T qt = calc_magnitude(qx, qy);
+    T q  = calc_magnitude(qx, qy, qz);
+    *cos_phi_z = qt > 0 ? -qx/qt : -1;
+    *sin_phi_z = qt > 0 ?  qy/qt :  0;
+    *cos_phi_y = qz/q;
+    *sin_phi_y = qt/q;
+}
+
+// === SIDIS FUNCTIONS =============================================================================
+// Momentum longitudinal to the virtual photon, given its momentum components and magnitude.
+template <typename T> T calc_Pl(T px, T py, T pz, T qx, T qy, T qz, T q) {
+    return (px*qx + py*qy + pz*qz) / q;
+}
+
+// Squared momentum transverse to the virtual photon. NOTE. Both terms nearly cancel each other for
+//     particles collinear with the photon, so rounding can leave a small negative result. It's
+//     clamped to 0 so that theta_pq doesn't take the square root of a negative number.
+template <typename T> T calc_Pt2(T px, T py, T pz, T pl) {
+    return std::max(px*px + py*py + pz*pz - pl*pl, (T) 0);
+}
+
+// Fraction of the virtual photon energy taken by a produced particle.
+template <typename T> T calc_zh(T px, T py, T pz, T mass, T nu) {
+    return std::sqrt(mass*mass + px*px + py*py + pz*pz) / nu;
+}
+
+// Polar angle of a produced particle with respect to the virtual photon.
+template <typename T> T calc_theta_pq(T pt2, T pl) {
+    return std::atan2(std::sqrt(pt2), pl);
+}
+
+// Azimuthal angle of a produced particle with respect to the virtual photon, given the rotation
+//     from calc_photon_rotation().
+template <typename T> T calc_phi_pq(T px, T py, T pz, T cos_phi_z, T sin_phi_z, T cos_phi_y,
+                                    T sin_phi_y) {
+    T x = px*cos_phi_z - py*sin_phi_z;
+    T y = px*sin_phi_z + py*cos_phi_z;
+    x = x*cos_phi_y + pz*sin_phi_y;
+    return std::atan2(y, x);
+}
+
+#endif
@@ -16,6 +16,7 @@
 
 #include <math.h>
 #include <stdbool.h>
+#include <vector>
 
 #include "bank_containers.h"
 #include "constants.h"
@@ -24,6 +25,8 @@
 #define PID_POSITIVE_SIZE 5
 #define PID_NEGATIVE_SIZE 4
 #define PID_NEUTRAL_SIZE  2
+#define PID_HYPOTHESES_MAX 5 // Size of the largest of the lists above.
+#define PARTICLE_BATCH_CHUNK 4096 // # of particles to accumulate before computing kinematics.
 extern const int PID_POSITIVE[PID_POSITIVE_SIZE];
 extern const int PID_NEGATIVE[PID_NEGATIVE_SIZE];
 extern const int PID_NEUTRAL[PID_NEUTRAL_SIZE];
@@ -44,19 +47,49 @@ typedef struct {
     float mass;
 } particle;
 
+// Detector information of a track, shared by its DC and FMT reconstructions.
+typedef struct {
+    int   recon_pid;
+    int   status;
+    int   sector;
+    float pcal_E, ecin_E, ecou_E, tot_E;
+    int   htcc_nphe, ltcc_nphe;
+    float tof;
+    float chi2, ndf;
+} track_info;
+
+// Event-level DIS kinematics, computed once from the trigger electron and shared by all hadrons.
+typedef struct {
+    bool is_valid;
+    double nu, Q2, Xb, W2, W;
+    // Virtual photon momentum and its magnitude.
+    double qx, qy, qz, q;
+    // Rotation into the virtual photon frame (around z by phi_z, then around y by phi_y).
+    double cos_phi_z, sin_phi_z, cos_phi_y, sin_phi_y;
+} dis_kinematics;
+
+// Particles stored as columns, so that kinematics can be computed for many particles at once.
+//     Particles from different events can share a batch, since each carries its event's DIS
+//     kinematics.
+typedef struct {
+    // Inputs.
+    std::vector<float> px, py, pz, mass;
+    std::vector<char>  is_sidis; // True if SIDIS variables are to be computed for the particle.
+    std::vector<double> nu, qx, qy, qz, q, cos_phi_z, sin_phi_z, cos_phi_y, sin_phi_y;
+    // Outputs.
+    std::vector<float> p, theta, phi, zh, pt2, pl2, phipq, thetapq;
+} particle_batch;
+
 // particle functions.
 particle particle_init();
 particle particle_init(REC_Particle * rp, REC_Track * rt, int pos);
 particle particle_init(REC_Particle * rp, REC_Track * rt, FMT_Tracks * ft, int pos);
 particle particle_init(int charge, double beta, int sector,
                        double vx, double vy, double vz, double px, double py, double pz);
-int set_pid(particle * p, int recon_pid, int status, double tot_E, double pcal_E, int htcc_nphe,
-            int ltcc_nphe, double sf_params[SF_NPARAMS][2]);
-bool is_electron(double tot_E, double pcal_E, double htcc_nphe, double p,
-                 double pars[SF_NPARAMS][2]);
+int set_pid_event(particle p[], track_info info[], int ntracks,
+                  double sf_params[NSECTORS][SF_NPARAMS][2]);
 int assign_neutral_pid(double tot_E, double beta);
 int best_pid_from_momentum(double p, double beta, int pid_list[], int pid_list_size);
-int match_pid(int hyp, bool r_match, int q, bool e, bool htcc_s, bool htcc_p);
 float d_from_beamline(particle p);
 float theta_lab(particle p);
 float phi_lab(particle p);
@@ -72,20 +105,28 @@ float theta_photon_lab(particle p, double beam_E);
 float phi_photon_lab(particle p);
 float W(particle p, double beam_E);
 float W2(particle p, double bE);
+dis_kinematics dis_kinematics_init();
+dis_kinematics dis_kinematics_init(particle e, double bE);
 
 // SIDIS produced particle functions.
-float theta_pq(particle p, particle e, double bE);
-float phi_pq(particle p, particle e, double bE);
-float cos_theta_pq(particle p, particle e, double bE);
-float Pt2(particle p, particle e, double bE);
-float Pl2(particle p, particle e, double bE);
-float zh(particle p, particle e, double bE);
-float PlCM(particle p, particle e, double bE);
-float PmaxCM(particle p, particle e, double bE);
-float PTrans2PQ(particle p, particle e, double bE);
-float PLong2PQ(particle p, particle e, double bE);
-float Xf(particle p, particle e, double bE);
-float Mx2(particle p, particle e, double bE);
-float t_mandelstam(particle p, particle e, double bE);
+float theta_pq(particle p, dis_kinematics k);
+float phi_pq(particle p, dis_kinematics k);
+float cos_theta_pq(particle p, dis_kinematics k);
+float Pt2(particle p, dis_kinematics k);
+float Pl2(particle p, dis_kinematics k);
+float zh(particle p, dis_kinematics k);
+float PlCM(particle p, dis_kinematics k);
+float PmaxCM(particle p, dis_kinematics k);
+float PTrans2PQ(particle p, dis_kinematics k);
+float PLong2PQ(particle p, dis_kinematics k);
+float Xf(particle p, dis_kinematics k);
+float Mx2(particle p, dis_kinematics k);
+float t_mandelstam(particle p, dis_kinematics k);
+
+// Batch functions.
+int particle_batch_add(particle_batch * b, particle p, dis_kinematics k);
+int particle_batch_size(particle_batch * b);
+int particle_batch_clear(particle_batch * b);
+int particle_batch_kinematics(particle_batch * b);
 
 #endif
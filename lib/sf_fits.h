@@ -0,0 +1,125 @@
+// CLAS12 RG-E Analyser.
+// Copyright (C) 2022 Bruno Benkel
+//
+// This program is free software: you can redistribute it and/or modify it under the terms of the
+// GNU Lesser General Public License as published by the Free Software Foundation, either version 3
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+// even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// Lesser General Public License for more details.
+//
+// You can see a copy of the GNU Lesser Public License under the LICENSE file.
+
+#ifndef SF_FITS
+#define SF_FITS
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <math.h>
+#include <thread>
+#include <time.h>
+#include <vector>
+
+#include <Math/MinimizerOptions.h>
+#include <TCanvas.h>
+#include <TFile.h>
+#include <TF1.h>
+#include <TFitResult.h>
+#include <TGraphErrors.h>
+#include <TH1.h>
+#include <TH1F.h>
+#include <TH2F.h>
+#include <TStyle.h>
+#include <TTree.h>
+
+#include "constants.h"
+#include "file_handler.h"
+#include "utilities.h"
+
+#define SF_NMOMS      (SF_NCALS * NSECTORS * SF_NPBINS * 3) // # of streaming moments.
+#define SF_STATE_TREE "sf_state" // Name of the metadata and moments TTree in state files.
+
+// Histograms filled by one worker. Histograms are booked in the same order for all workers, so the
+//     handles are valid for all of them. The E/p distribution of each momentum bin is a slice of
+//     SF_PSUBDIV momentum bins of the 2D histograms, see project_sf_slices().
+typedef struct {
+    histo_registry histos;
+    int sf2D_h[SF_NCALS][NSECTORS];
+    // Streaming E/p moments (entries, sum, and sum of squares) within PLIMITSARR for each momentum
+    //     bin. They're kept in fixed point so that merging them is exact.
+    long long sf_mom[SF_NCALS][NSECTORS][SF_NPBINS][3];
+} sf_histos;
+
+// Result of the fit to one momentum bin.
+typedef struct {
+    double mean;
+    double mean_err; // Only used by the fast fits.
+    double sigma;
+    bool   is_valid; // Within PLIMITSARR borders and with an acceptable chi2.
+    int    status;   // Minuit status, 0 if it converged. Only used by the Minuit fits.
+    int    ncalls;   // Minuit function calls. Only used by the Minuit fits.
+} sf_binfit;
+
+// Starting values for the Minuit fits, taken from a reference run. Fits without a seed start from
+//     the same constants as before.
+typedef struct {
+    bool   has_graph[SF_NCALS][NSECTORS];
+    double graph[SF_NCALS][NSECTORS][SF_NPARAMS];
+    bool   has_bin[SF_NCALS][NSECTORS][SF_NPBINS];
+    double bin[SF_NCALS][NSECTORS][SF_NPBINS][2]; // Mean and sigma.
+} sf_seeds;
+
+// Convergence statistics of a set of Minuit fits.
+typedef struct {
+    int  bin_fits;
+    long bin_calls;
+    int  bin_failed;   // Minuit didn't converge.
+    int  bin_rejected; // Not used for the dotgraph fit.
+    int  graph_fits;
+    long graph_calls;
+    int  graph_failed;
+} sf_fitstats;
+
+int book_sf_histos(sf_histos *h);
+int get_sf_pedges(double p_edges[SF_NPBINS]);
+int fill_sf_track(sf_histos *h, double tot_P, double sf_E[SF_NCALS][NSECTORS], long *nfills);
+int project_sf_slices(sf_histos *h, TH1 *slices[SF_NCALS][NSECTORS][SF_NPBINS]);
+int free_sf_slices(TH1 *slices[SF_NCALS][NSECTORS][SF_NPBINS]);
+int merge_sf_histos(sf_histos *dst, sf_histos *src);
+int free_sf_histos(sf_histos *h);
+int reset_sf_histos(sf_histos *h);
+int write_sf_state(sf_histos *h, const char *filename, int run_no, bool use_fmt, long nevents);
+int read_sf_state(sf_histos *h, const char *filename, int *run_no, bool *use_fmt, long *nevents);
+int get_sf_seeds(sf_seeds *seeds, char *filename);
+int fit_sf_bin(TH1 *EdivP, int ci, int si, double p, const double seed[2], sf_binfit *r);
+int fit_sf_graph(sf_binfit r[SF_NPBINS], double p_edges[SF_NPBINS], TGraphErrors *dotgraph,
+                 TF1 *polyfit, const double seed[SF_NPARAMS], double fitresults[SF_NPARAMS][2],
+                 int *ncalls);
+int fit_sf(TH1 *slices[SF_NCALS][NSECTORS][SF_NPBINS], TGraphErrors *dotgraph[SF_NCALS][NSECTORS],
+           TF1 *polyfit[SF_NCALS][NSECTORS], double fitresults[SF_NCALS][NSECTORS][SF_NPARAMS][2],
+           bool mask[SF_NCALS][NSECTORS], int nthreads, const sf_seeds *seeds,
+           sf_fitstats *stats);
+int fit_sf_bin_fast(TH1 *EdivP, long long mom[3], int ci, sf_binfit *r);
+int fit_sf_graph_fast(sf_binfit r[SF_NPBINS], double p_edges[SF_NPBINS], TGraphErrors *dotgraph,
+                      TF1 *polyfit, double fitresults[SF_NPARAMS][2]);
+int fit_sf_fast(sf_histos *h, TH1 *slices[SF_NCALS][NSECTORS][SF_NPBINS],
+                TGraphErrors *dotgraph[SF_NCALS][NSECTORS],
+                TF1 *polyfit[SF_NCALS][NSECTORS],
+                double fitresults[SF_NCALS][NSECTORS][SF_NPARAMS][2],
+                bool failed[SF_NCALS][NSECTORS]);
+double sf_max_error(sf_histos *h, TGraphErrors *dotgraph[SF_NCALS][NSECTORS],
+                    TF1 *polyfit[SF_NCALS][NSECTORS]);
+int print_sf_comparison(double fast[SF_NCALS][NSECTORS][SF_NPARAMS][2],
+                        double minuit[SF_NCALS][NSECTORS][SF_NPARAMS][2],
+                        bool fast_failed[SF_NCALS][NSECTORS]);
+int init_sf_fits(TGraphErrors *dotgraph[SF_NCALS][NSECTORS], TF1 *polyfit[SF_NCALS][NSECTORS],
+                 const char *suffix);
+int print_sf_fitstats(sf_fitstats *stats);
+int fit_and_save_sf(sf_histos *h, int run_no, bool fast_fit, bool cmp_fits, int nthreads,
+                    const sf_seeds *seeds);
+
+#endif
@@ -14,30 +14,56 @@
 #ifndef UTILS
 #define UTILS
 
-#include <map>
 #include <math.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <map>
+#include <vector>
 
 #include <TH1.h>
 #include <TH1F.h>
 #include <TH2F.h>
 
 #include "constants.h"
+#include "kinematics.h"
+
+// Dense histogram registry. Histograms are stored contiguously and accessed through the integer
+//     handle returned when booking them, so that filling doesn't require any lookup.
+typedef struct {
+    std::vector<TH1 *> histos;
+} histo_registry;
+
+// Heap bitset of the events of one run. Bit i of the bitset is event first + i, so that it only
+//     spans the events between the lowest and highest ones added. first is a multiple of 64.
+typedef struct {
+    long long             first;
+    std::vector<uint64_t> words;
+} evn_bitset;
+
+// Set of selected events, keyed by their (run, event) key. Each run has its own bitset, grown on
+//     either end as events outside of it are added.
+typedef struct {
+    std::map<int, evn_bitset> runs;
+} evn_selection;
 
-double to_deg(double radians);
-double calc_magnitude(double x, double y);
-double calc_magnitude(double x, double y, double z);
-double calc_angle(double x1, double y1, double z1, double x2, double y2, double z2);
-void rotate_y(double *x, double *z, double th);
-void rotate_z(double *x, double *y, double th);
 bool catch_yn();
 int catch_string(const char * list[], int size);
+int find_string(const char * list[], int size, const char * str);
+int catch_line(char * str, int size);
 double catch_double();
 long catch_long();
-int insert_TH1F(std::map<const char *, TH1 *> *map, const char *k, const char *n, const char *xn,
-               int bins, double min, double max);
-int insert_TH2F(std::map<const char *, TH1 *> *map, const char *k,
-                const char *n, const char *nx, const char *ny,
+int book_TH1F(histo_registry *r, const char *k, const char *n, const char *xn,
+              int bins, double min, double max);
+int book_TH2F(histo_registry *r, const char *k, const char *n, const char *nx, const char *ny,
                 int xbins, double xmin, double xmax, int ybins, double ymin, double ymax);
+int evn_key(int run_no, long long evn, long long * key);
+int evn_key_run(long long key);
+long long evn_key_evn(long long key);
+int evn_bitset_cover(evn_bitset *b, long long first_word, long long last_word);
+int evn_selection_set(evn_selection *s, long long key, bool selected);
+bool evn_selection_get(const evn_selection *s, long long key);
+int evn_selection_merge(evn_selection *dst, const evn_selection *src);
+long evn_selection_count(const evn_selection *s, int run_no);
+long evn_selection_bytes(const evn_selection *s);
 
 #endif
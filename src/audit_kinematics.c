@@ -0,0 +1,403 @@
+// CLAS12 RG-E Analyser.
+// Copyright (C) 2022 Bruno Benkel
+//
+// This program is free software: you can redistribute it and/or modify it under the terms of the
+// GNU Lesser General Public License as published by the Free Software Foundation, either version 3
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+// even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// Lesser General Public License for more details.
+//
+// You can see a copy of the GNU Lesser Public License under the LICENSE file.
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+#include <map>
+
+#include "../lib/constants.h"
+#include "../lib/err_handler.h"
+#include "../lib/io_handler.h"
+#include "../lib/kinematics.h"
+#include "../lib/particle.h"
+
+// Compare the float and double versions of the templates in `kinematics.h` over a synthetic sample
+//     of SIDIS events, reporting the maximum error of each variable and the throughput of each
+//     precision. The cost per hadron of the SIDIS variables is also compared between recomputing
+//     the electron's kinematics for each hadron, as particle.c did before, and the functions of
+//     particle.c, which take them from the dis_kinematics of the event. Finally, the batch
+//     kinematics of particle.c are checked against its scalar functions, and pid_mass() is timed
+//     against the std::map it replaced.
+
+#define AUDIT_BEAME    10.6  // Beam energy used for synthetic events.
+#define AUDIT_MAXHADS  8     // Max number of hadrons per synthetic event.
+#define AUDIT_RELTOL   1e-5  // Max relative error to consider float safe for a variable.
+#define AUDIT_NVARS    12
+const char * AUDIT_VARS[AUDIT_NVARS] = {
+        R_P, R_THETA, R_PHI, R_NU, R_Q2, R_XB, R_W2, R_ZH, R_PT2, R_PL2, R_PHIPQ, R_THETAPQ
+};
+#define AUDIT_NSIDIS   5     // zh, Pt2, Pl2, phi_pq, and theta_pq, last in AUDIT_VARS.
+#define AUDIT_BATCHTOL 1e-6  // Max relative error of batch kinematics against the scalar ones.
+#define AUDIT_NBATCH   8
+const char * AUDIT_BATCH_VARS[AUDIT_NBATCH] = {
+        R_P, R_THETA, R_PHI, R_ZH, R_PT2, R_PL2, R_PHIPQ, R_THETAPQ
+};
+
+// Masses as constants.c kept them before PID_TABLE, used as the reference for pid_mass().
+#define AUDIT_NPIDS 8 // Common species, looked up by the benchmark.
+const int AUDIT_PIDS[AUDIT_NPIDS] = {11, 211, -211, 321, -321, 2212, 2112, 22};
+const std::map<int, double> AUDIT_MASS = {
+        {11, 0.000051}, {-11, 0.000051}, {2212, 0.938272}, {-2212, 0.938272}, {2112, 0.939565},
+        {211, 0.139570}, {-211, 0.139570}, {321, 0.493677}, {-321, 0.493677}, {22, 0.},
+        {45, -1.}, {0, -1.}
+};
+
+// Get a uniformly distributed random number between min and max.
+double uniform(double min, double max) {
+    return min + (max - min) * drand48();
+}
+
+// Build a particle of the synthetic sample from its momentum, as set_pid_event() leaves it.
+particle audit_particle(const float v[3], int pid, bool is_trigger_electron) {
+    particle p = particle_init(pid_charge(pid), 1., 1, 0., 0., 0., v[0], v[1], v[2]);
+    p.pid                 = pid;
+    p.mass                = pid_mass(pid);
+    p.is_trigger_electron = is_trigger_electron;
+    p.is_hadron           = !is_trigger_electron;
+    return p;
+}
+
+// Compute all variables for one hadron. `e` holds the electron momentum components and `h` holds the
+//     hadron's momentum components and mass.
+template <typename T> void audit_compute(const float e[3], const float h[4], T out[AUDIT_NVARS]) {
+    T bE  = AUDIT_BEAME;
+    T epx = e[0], epy = e[1], epz = e[2];
+    T hpx = h[0], hpy = h[1], hpz = h[2], hm = h[3];
+
+    // DIS.
+    T ep = calc_magnitude(epx, epy, epz);
+    T nu = calc_nu(bE, ep);
+    T Q2 = calc_Q2(bE, ep, calc_theta_lab(epx, epy, epz));
+
+    // Virtual photon.
+    T qx = -epx, qy = -epy, qz = bE - epz;
+    T q  = calc_magnitude(qx, qy, qz);
+    T cz, sz, cy, sy;
+    calc_photon_rotation(qx, qy, qz, &cz, &sz, &cy, &sy);
+
+    // SIDIS.
+    T pl  = calc_Pl(hpx, hpy, hpz, qx, qy, qz, q);
+    T pt2 = calc_Pt2(hpx, hpy, hpz, pl);
+
+    out[0]  = calc_magnitude(hpx, hpy, hpz);
+    out[1]  = calc_theta_lab(hpx, hpy, hpz);
+    out[2]  = calc_phi_lab(hpx, hpy);
+    out[3]  = nu;
+    out[4]  = Q2;
+    out[5]  = calc_Xb(Q2, nu);
+    out[6]  = calc_W2(Q2, nu);
+    out[7]  = calc_zh(hpx, hpy, hpz, hm, nu);
+    out[8]  = pt2;
+    out[9]  = pl*pl;
+    out[10] = calc_phi_pq(hpx, hpy, hpz, cz, sz, cy, sy);
+    out[11] = calc_theta_pq(pt2, pl);
+}
+
+// Compute the SIDIS variables of one hadron without any cache, recomputing the electron's
+//     kinematics and the rotation to the virtual photon frame for each hadron. This is how
+//     particle.c computed them before caching them in dis_kinematics, and it's kept as the
+//     reference for the functions of particle.c.
+void sidis_uncached(const float e[3], const float h[4], double out[AUDIT_NSIDIS]) {
+    double bE  = AUDIT_BEAME;
+    double epx = e[0], epy = e[1], epz = e[2];
+    double hpx = h[0], hpy = h[1], hpz = h[2];
+
+    double ep  = calc_magnitude(epx, epy, epz);
+    double nu  = calc_nu(bE, ep);
+    double Q2  = calc_Q2(bE, ep, calc_theta_lab(epx, epy, epz));
+    double hp  = calc_magnitude(hpx, hpy, hpz);
+    double cpq = (hpz*(bE - epz) - hpx*epx - hpy*epy) / (sqrt(nu*nu + Q2) * hp);
+
+    // Rotate both the photon and the hadron to find phi_pq.
+    double gpx = -epx, gpy = -epy, gpz = bE - epz;
+    double ppx =  hpx, ppy =  hpy, ppz = hpz;
+    double phi_z = M_PI - atan2(gpy, gpx);
+    rotate_z(&gpx, &gpy, phi_z);
+    rotate_z(&ppx, &ppy, phi_z);
+    rotate_y(&ppx, &ppz, calc_angle(gpx, gpy, gpz, 0., 0., 1.));
+
+    out[0] = calc_zh(hpx, hpy, hpz, (double) h[3], nu);
+    out[1] = hp*hp * (1 - cpq*cpq);
+    out[2] = hp*hp * cpq*cpq;
+    out[3] = atan2(ppy, ppx);
+    out[4] = calc_angle(-epx, -epy, bE - epz, hpx, hpy, hpz);
+}
+
+// Compute the SIDIS variables of one hadron hp with the functions of particle.c, from the
+//     dis_kinematics k of its event.
+void sidis_cached(particle hp, dis_kinematics k, double out[AUDIT_NSIDIS]) {
+    out[0] = zh      (hp, k);
+    out[1] = Pt2     (hp, k);
+    out[2] = Pl2     (hp, k);
+    out[3] = phi_pq  (hp, k);
+    out[4] = theta_pq(hp, k);
+}
+
+// Compute the SIDIS variables of all hadrons with or without the per-event cache, returning the
+//     time taken in ns. The uncached path reads the momenta in e and h, and the cached one the
+//     particles ep and hp built from them. Hadrons of the same event are contiguous, so the cache
+//     is rebuilt only when the event changes.
+double audit_time_sidis(bool cached, int nhads, float (* e)[3], float (* h)[4], particle * ep,
+                        particle * hp, int * hevn, double * checksum) {
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    double         sum  = 0;
+    dis_kinematics k    = dis_kinematics_init();
+    int            kevn = -1;
+    for (int hi = 0; hi < nhads; ++hi) {
+        double v[AUDIT_NSIDIS];
+        if (cached) {
+            if (hevn[hi] != kevn) {
+                k    = dis_kinematics_init(ep[hevn[hi]], AUDIT_BEAME);
+                kevn = hevn[hi];
+            }
+            sidis_cached(hp[hi], k, v);
+        }
+        else {
+            sidis_uncached(e[hevn[hi]], h[hi], v);
+        }
+        for (int vi = 0; vi < AUDIT_NSIDIS; ++vi) sum += v[vi];
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    * checksum += sum; // Keep the compiler from dropping the loop.
+    return (t1.tv_sec - t0.tv_sec)*1e9 + (t1.tv_nsec - t0.tv_nsec);
+}
+
+// Run audit_compute() over the full sample, returning the time taken in ns.
+template <typename T> double audit_time(int nhads, float (* e)[3], float (* h)[4], int * hevn,
+                                        double * checksum) {
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    T sum = 0;
+    for (int hi = 0; hi < nhads; ++hi) {
+        T out[AUDIT_NVARS];
+        audit_compute<T>(e[hevn[hi]], h[hi], out);
+        for (int vi = 0; vi < AUDIT_NVARS; ++vi) sum += out[vi];
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    * checksum += sum; // Keep the compiler from dropping the loop.
+    return (t1.tv_sec - t0.tv_sec)*1e9 + (t1.tv_nsec - t0.tv_nsec);
+}
+
+// Compute the kinematics of the electrons ep and hadrons hp of the sample with
+//     particle_batch_kinematics(), in batches of PARTICLE_BATCH_CHUNK particles as make_ntuples
+//     does, and store the max relative error of each variable against the scalar functions in
+//     max_rel. Values under 1e-9 are compared by their absolute error instead.
+int audit_batch(int nhads, particle * ep, particle * hp, int * hevn,
+                double max_rel[AUDIT_NBATCH]) {
+    for (int vi = 0; vi < AUDIT_NBATCH; ++vi) max_rel[vi] = 0;
+
+    particle_batch              b;
+    std::vector<particle>       bp; // Particles in the batch, with their event's kinematics.
+    std::vector<dis_kinematics> bk;
+    dis_kinematics              k = dis_kinematics_init();
+    for (int hi = 0; hi <= nhads; ++hi) {
+        // Add each event's electron before its first hadron.
+        if (hi < nhads && (hi == 0 || hevn[hi] != hevn[hi-1])) {
+            k = dis_kinematics_init(ep[hevn[hi]], AUDIT_BEAME);
+            bp.push_back(ep[hevn[hi]]);
+            bk.push_back(k);
+            particle_batch_add(&b, ep[hevn[hi]], k);
+        }
+        if (hi < nhads) {
+            bp.push_back(hp[hi]);
+            bk.push_back(k);
+            particle_batch_add(&b, hp[hi], k);
+        }
+        if (particle_batch_size(&b) < PARTICLE_BATCH_CHUNK && hi < nhads) continue;
+
+        particle_batch_kinematics(&b);
+        for (UInt_t pi = 0; pi < bp.size(); ++pi) {
+            particle       p  = bp[pi];
+            dis_kinematics pk = bk[pi];
+            double batch [AUDIT_NBATCH] = {
+                    b.p[pi], b.theta[pi], b.phi[pi], b.zh[pi], b.pt2[pi], b.pl2[pi],
+                    b.phipq[pi], b.thetapq[pi]
+            };
+            double scalar[AUDIT_NBATCH] = {
+                    P(p), theta_lab(p), phi_lab(p), zh(p, pk), Pt2(p, pk), Pl2(p, pk),
+                    phi_pq(p, pk), theta_pq(p, pk)
+            };
+            for (int vi = 0; vi < AUDIT_NBATCH; ++vi) {
+                double err = fabs(batch[vi] - scalar[vi]);
+                if (fabs(scalar[vi]) > 1e-9) err /= fabs(scalar[vi]);
+                if (err > max_rel[vi]) max_rel[vi] = err;
+            }
+        }
+        particle_batch_clear(&b);
+        bp.clear();
+        bk.clear();
+    }
+    return 0;
+}
+
+// Look up the masses of n random PIDs from AUDIT_PIDS with pid_mass() and with the AUDIT_MASS map,
+//     storing the time taken by each in ns per lookup. Returns 3 if any mass in AUDIT_MASS
+//     differs from pid_mass().
+int audit_pid_lookup(long n, double * map_ns, double * table_ns, double * checksum) {
+    for (const std::pair<const int, double> &m : AUDIT_MASS) {
+        if (pid_mass(m.first) != m.second) return 3;
+    }
+
+    std::vector<int> pids(n);
+    for (long i = 0; i < n; ++i) pids[i] = AUDIT_PIDS[(int) (drand48() * AUDIT_NPIDS)];
+
+    struct timespec t0, t1, t2;
+    double sum_map   = 0;
+    double sum_table = 0;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (long i = 0; i < n; ++i) sum_map += AUDIT_MASS.at(pids[i]);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    for (long i = 0; i < n; ++i) sum_table += pid_mass(pids[i]);
+    clock_gettime(CLOCK_MONOTONIC, &t2);
+
+    * map_ns   = ((t1.tv_sec - t0.tv_sec)*1e9 + (t1.tv_nsec - t0.tv_nsec)) / n;
+    * table_ns = ((t2.tv_sec - t1.tv_sec)*1e9 + (t2.tv_nsec - t1.tv_nsec)) / n;
+    * checksum += sum_map + sum_table; // Keep the compiler from dropping the loops.
+    return 0;
+}
+
+int run(int nevn) {
+    // Generate synthetic sample within CLAS12's forward detector acceptance.
+    float (* e)[3] = (float (*)[3]) malloc(nevn * sizeof(*e));
+    float (* h)[4] = (float (*)[4]) malloc(nevn * AUDIT_MAXHADS * sizeof(*h));
+    int   * hevn   = (int *)        malloc(nevn * AUDIT_MAXHADS * sizeof(int));
+    std::vector<particle> ep(nevn);
+    std::vector<particle> hp(nevn * AUDIT_MAXHADS);
+    if (e == NULL || h == NULL || hevn == NULL) return 1;
+
+    srand48(1);
+    int nhads = 0;
+    for (int evn = 0; evn < nevn; ++evn) {
+        double p     = uniform(1., 9.);
+        double theta = uniform(5., 35.) * M_PI/180;
+        double phi   = uniform(-M_PI, M_PI);
+        e[evn][0] = p * sin(theta) * cos(phi);
+        e[evn][1] = p * sin(theta) * sin(phi);
+        e[evn][2] = p * cos(theta);
+        ep[evn]   = audit_particle(e[evn], 11, true);
+
+        int n = 1 + (int) (drand48() * AUDIT_MAXHADS);
+        for (int hi = 0; hi < n; ++hi) {
+            p     = uniform(0.2, 8.);
+            theta = uniform(5., 120.) * M_PI/180;
+            phi   = uniform(-M_PI, M_PI);
+            h[nhads][0] = p * sin(theta) * cos(phi);
+            h[nhads][1] = p * sin(theta) * sin(phi);
+            h[nhads][2] = p * cos(theta);
+            h[nhads][3] = pid_mass(211);
+            hp[nhads]   = audit_particle(h[nhads], 211, false);
+            hevn[nhads] = evn;
+            nhads++;
+        }
+    }
+    printf("Generated %d events with %d hadrons.\n", nevn, nhads);
+
+    // Find maximum error of each variable.
+    double max_abs[AUDIT_NVARS];
+    double max_rel[AUDIT_NVARS];
+    for (int vi = 0; vi < AUDIT_NVARS; ++vi) {
+        max_abs[vi] = 0;
+        max_rel[vi] = 0;
+    }
+    for (int hi = 0; hi < nhads; ++hi) {
+        float  out_f[AUDIT_NVARS];
+        double out_d[AUDIT_NVARS];
+        audit_compute<float> (e[hevn[hi]], h[hi], out_f);
+        audit_compute<double>(e[hevn[hi]], h[hi], out_d);
+        for (int vi = 0; vi < AUDIT_NVARS; ++vi) {
+            double abs_err = fabs(out_f[vi] - out_d[vi]);
+            if (abs_err > max_abs[vi]) max_abs[vi] = abs_err;
+            if (fabs(out_d[vi]) > 1e-9 && abs_err/fabs(out_d[vi]) > max_rel[vi])
+                max_rel[vi] = abs_err/fabs(out_d[vi]);
+        }
+    }
+
+    // Measure throughput, and the cost of the SIDIS variables with and without the cache.
+    double checksum = 0;
+    double ns_f = audit_time<float> (nhads, e, h, hevn, &checksum);
+    double ns_d = audit_time<double>(nhads, e, h, hevn, &checksum);
+    double ns_u = audit_time_sidis(false, nhads, e, h, ep.data(), hp.data(), hevn, &checksum);
+    double ns_c = audit_time_sidis(true,  nhads, e, h, ep.data(), hp.data(), hevn, &checksum);
+
+    // Check that particle.c matches the uncached SIDIS variables. It returns floats, so they can
+    //     only agree to float precision.
+    double sidis_diff[AUDIT_NSIDIS];
+    for (int vi = 0; vi < AUDIT_NSIDIS; ++vi) sidis_diff[vi] = 0;
+    for (int hi = 0; hi < nhads; ++hi) {
+        double out_u[AUDIT_NSIDIS];
+        double out_c[AUDIT_NSIDIS];
+        sidis_uncached(e[hevn[hi]], h[hi], out_u);
+        sidis_cached(hp[hi], dis_kinematics_init(ep[hevn[hi]], AUDIT_BEAME), out_c);
+        for (int vi = 0; vi < AUDIT_NSIDIS; ++vi) {
+            double diff = fabs(out_u[vi] - out_c[vi]);
+            if (diff > sidis_diff[vi]) sidis_diff[vi] = diff;
+        }
+    }
+
+    // Check the batch kinematics written by make_ntuples against the scalar ones.
+    double batch_rel[AUDIT_NBATCH];
+    audit_batch(nhads, ep.data(), hp.data(), hevn, batch_rel);
+
+    // Time PID mass lookups.
+    double map_ns, table_ns;
+    if (audit_pid_lookup(AUDIT_MAXHADS * (long) nevn, &map_ns, &table_ns, &checksum)) return 3;
+
+    // Print results.
+    printf("\n%-12s %14s %14s %10s\n", "variable", "max abs err", "max rel err", "suggested");
+    for (int vi = 0; vi < AUDIT_NVARS; ++vi) {
+        printf("%-12s %14.4e %14.4e %10s\n", AUDIT_VARS[vi], max_abs[vi], max_rel[vi],
+               max_rel[vi] < AUDIT_RELTOL ? "float" : "double");
+    }
+    printf("\nthroughput: float %.2f ns per hadron, double %.2f ns per hadron (checksum %g).\n",
+           ns_f/nhads, ns_d/nhads, checksum);
+    printf("SIDIS variables: uncached %.2f ns per hadron, particle.c with dis_kinematics %.2f ns "
+           "per hadron (%.2fx).\n", ns_u/nhads, ns_c/nhads, ns_c > 0 ? ns_u/ns_c : 0.);
+    printf("max abs difference between both:");
+    for (int vi = 0; vi < AUDIT_NSIDIS; ++vi) {
+        printf(" %s %.2e", AUDIT_VARS[AUDIT_NVARS - AUDIT_NSIDIS + vi], sidis_diff[vi]);
+    }
+    printf("\n");
+
+    printf("PID mass lookups: std::map %.2f ns, PID_TABLE %.2f ns (%.2fx).\n", map_ns, table_ns,
+           table_ns > 0 ? map_ns/table_ns : 0.);
+
+    bool batch_ok = true;
+    printf("\n%-12s %14s\n", "batch var", "max rel err");
+    for (int vi = 0; vi < AUDIT_NBATCH; ++vi) {
+        printf("%-12s %14.4e\n", AUDIT_BATCH_VARS[vi], batch_rel[vi]);
+        if (batch_rel[vi] > AUDIT_BATCHTOL) batch_ok = false;
+    }
+
+    free(e);
+    free(h);
+    free(hevn);
+    if (!batch_ok) return 2;
+    printf("OK.\n");
+    return 0;
+}
+
+// Call program from terminal, C-style.
+int main(int argc, char ** argv) {
+    int nevn = 1000000;
+
+    if (audit_kinematics_handle_args_err(audit_kinematics_handle_args(argc, argv, &nevn)))
+        return 1;
+
+    return audit_kinematics_err(run(nevn));
+}
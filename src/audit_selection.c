@@ -0,0 +1,106 @@
+// CLAS12 RG-E Analyser.
+// Copyright (C) 2022 Bruno Benkel
+//
+// This program is free software: you can redistribute it and/or modify it under the terms of the
+// GNU Lesser General Public License as published by the Free Software Foundation, either version 3
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+// even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// Lesser General Public License for more details.
+//
+// You can see a copy of the GNU Lesser Public License under the LICENSE file.
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "../lib/constants.h"
+#include "../lib/err_handler.h"
+#include "../lib/io_handler.h"
+#include "../lib/utilities.h"
+
+// Fill an evn_selection with every event of several synthetic runs, then check that each event
+//     reads back as it was set and that the selection takes no more memory than its bitsets need.
+
+#define AUDIT_RUN0     12000     // Run number of the first synthetic run.
+#define AUDIT_FIRSTEVN (1LL<<36) // First event number of each run, far from 0 to test offsets.
+
+// Decide if an event is selected, as a fixed pseudo-random function of its number. About 3 in 8
+//     events are selected.
+bool audit_selected(long long evn) {
+    return (((uint64_t) evn * 0x9E3779B97F4A7C15ULL) >> 61) < 3;
+}
+
+// Get the time between t0 and t1 in s.
+double audit_elapsed(struct timespec t0, struct timespec t1) {
+    return (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec)*1e-9;
+}
+
+int run(int nruns, long long nevents) {
+    evn_selection s;
+    long long     key;
+    struct timespec t0, t1;
+
+    // Fill.
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    long long nselected = 0;
+    for (int ri = 0; ri < nruns; ++ri) {
+        for (long long evn = AUDIT_FIRSTEVN; evn < AUDIT_FIRSTEVN + nevents; ++evn) {
+            if (evn_key(AUDIT_RUN0 + ri, evn, &key)) return 1;
+            bool selected = audit_selected(evn);
+            evn_selection_set(&s, key, selected);
+            nselected += selected;
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    double fill_s = audit_elapsed(t0, t1);
+    printf("Set %lld events from %d runs (%lld selected) in %.2f s (%.1f M events/s).\n",
+           nruns*nevents, nruns, nselected, fill_s, nruns*nevents/fill_s*1e-6);
+
+    // Query every event, plus the events just outside each run and a run that was never added.
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    long long nbad = 0;
+    for (int ri = 0; ri < nruns; ++ri) {
+        for (long long evn = AUDIT_FIRSTEVN; evn < AUDIT_FIRSTEVN + nevents; ++evn) {
+            if (evn_key(AUDIT_RUN0 + ri, evn, &key)) return 1;
+            if (evn_selection_get(&s, key) != audit_selected(evn)) nbad++;
+        }
+        for (long long di = 1; di <= 128; ++di) {
+            if (evn_key(AUDIT_RUN0 + ri, AUDIT_FIRSTEVN - di, &key)) return 1;
+            if (evn_selection_get(&s, key)) nbad++;
+            if (evn_key(AUDIT_RUN0 + ri, AUDIT_FIRSTEVN + nevents - 1 + di, &key)) return 1;
+            if (evn_selection_get(&s, key)) nbad++;
+        }
+    }
+    if (evn_key(AUDIT_RUN0 + nruns, AUDIT_FIRSTEVN, &key)) return 1;
+    if (evn_selection_get(&s, key)) nbad++;
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    double get_s = audit_elapsed(t0, t1);
+    printf("Queried them in %.2f s (%.1f M events/s). %lld events read back wrong.\n", get_s,
+           nruns*nevents/get_s*1e-6, nbad);
+
+    // Each run needs one bit per event. Allow for the vectors' growth, which can double them.
+    long   bytes     = evn_selection_bytes(&s);
+    double min_bytes = nruns * ((nevents + 63)/64 + 1) * 8.;
+    printf("Selection takes %.1f MB, %.2f times the %.1f MB its bits need.\n", bytes/1e6,
+           bytes/min_bytes, min_bytes/1e6);
+
+    if (nbad > 0)                return 2;
+    if (bytes > 2*min_bytes + 64) return 3;
+    printf("OK.\n");
+    return 0;
+}
+
+// Call program from terminal, C-style.
+int main(int argc, char ** argv) {
+    int       nruns   = 3;
+    long long nevents = 120000000;
+
+    if (audit_selection_handle_args_err(audit_selection_handle_args(argc, argv, &nruns,
+            &nevents)))
+        return 1;
+
+    return audit_selection_err(run(nruns, nevents));
+}
@@ -15,6 +15,43 @@
 
 // TODO. This file could use a lot of improvement using interfaces and smart array handling.
 // TODO. All strings here should be handled by `constants.h`.
+RUN_Config::RUN_Config() {
+    nrows = 0;
+    run   = {};
+    event = {};
+}
+RUN_Config::RUN_Config(TTree *t) {
+    run   = nullptr; b_run   = nullptr;
+    event = nullptr; b_event = nullptr;
+    t->SetBranchAddress("RUN::config::run",   &run,   &b_run);
+    t->SetBranchAddress("RUN::config::event", &event, &b_event);
+}
+int RUN_Config::link_branches(TTree *t) {
+    t->Branch("RUN::config::run",   &run);
+    t->Branch("RUN::config::event", &event);
+    return 0;
+}
+int RUN_Config::set_nrows(int in_nrows) {
+    nrows = in_nrows;
+    run  ->resize(nrows);
+    event->resize(nrows);
+    return 0;
+}
+int RUN_Config::get_nrows() {return nrows;}
+int RUN_Config::fill(hipo::bank b) {
+    set_nrows(b.getRows());
+    for (int row = 0; row < nrows; ++row) {
+        run  ->at(row) = b.getInt("run",   row);
+        event->at(row) = b.getInt("event", row);
+    }
+    return 0;
+}
+int RUN_Config::get_entries(TTree *t, int idx) {
+    b_run  ->GetEntry(t->LoadTree(idx));
+    b_event->GetEntry(t->LoadTree(idx));
+    return 0;
+}
+
 REC_Particle::REC_Particle() {
     nrows   = 0;
     pid     = {};
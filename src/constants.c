@@ -13,34 +13,6 @@
 
 #include "../lib/constants.h"
 
-// Mass map in GeV.
-const std::map<int, double> MASS = {
-        {        11,  0.000051}, // electron.
-        {       -11,  0.000051}, // positron.
-        {      2212,  0.938272}, // proton.
-        {     -2212,  0.938272}, // antiproton.
-        {      2112,  0.939565}, // neutron.
-        {       211,  0.139570}, // positive pion.
-        {      -211,  0.139570}, // negative pion.
-        {       321,  0.493677}, // positive kaon.
-        {      -321,  0.493677}, // negative kaon.
-        // {        13,  0.105658}, // positive muon. *not yet implemented*.
-        // {       -13,  0.105658}, // negative muon. *not yet implemented*.
-        // {       111,  0.134977}, // neutral pion. *not yet implemented*.
-        // {       311,  0.497614}, // neutral kaon. *not yet implemented*.
-        {        22,  0.},       // photon.
-        // {       221,  0.548953}, // eta. *not yet implemented*.
-        // {       223,  0.782650}, // omega. *not yet implemented*.
-        // {1000010020,  1.875},    // deuterium. *not yet implemented*.
-        {        45, -1.},       // unidentified particle.
-        {         0, -1.}        // unidentified particle.
-};
-
-// PID qa map.
-const std::map<int, int> PID_QA = {
-    {11, 0}, {211, 1}, {321, 2}, {2212, 3}, {2112, 4}, {22, 5}
-};
-
 // Trackers array.
 const char * TRK_LIST[TRK_LIST_SIZE] = {
     S_DC, S_FMT
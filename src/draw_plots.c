@@ -11,11 +11,21 @@
 //
 // You can see a copy of the GNU Lesser Public License under the LICENSE file.
 
+#include <ctype.h>
 #include <math.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <time.h>
+#include <algorithm>
+#include <atomic>
 #include <climits>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
 
 #include <TCanvas.h>
 #include <TFile.h>
@@ -23,8 +33,12 @@
 #include <TH1F.h>
 #include <TH2F.h>
 #include <TNtuple.h>
+#include <TROOT.h>
 
 #include "../lib/constants.h"
+#include "../lib/err_handler.h"
+#include "../lib/expression.h"
+#include "../lib/io_handler.h"
 #include "../lib/utilities.h"
 
 // TODO. See why I'm not seeing any neutrals. -> Ask Raffa.
@@ -42,163 +56,676 @@
 // TODO. See what happens to low-momentum particles inside CLAS12 through simulation and see if they
 //       are reconstructed.
 
-// Assign name to plots, recursively going through binnings.
-int name_plt(TH1 * plt[], TString * name, const char * nx, const char * ny, int * idx, long dbins,
-             long depth, int px, long bx[], double rx[][2], int bvx[], long bbx[], double brx[][2],
-             double b_interval[]) {
-    if (depth == dbins) {
-        // Create plot and increase index.
-        if (px == 0) plt[* idx] =
-                new TH1F(* name, Form("%s;%s", name->Data(), nx), bx[0], rx[0][0], rx[0][1]);
-        if (px == 1) plt[* idx] =
-                new TH2F(* name, Form("%s;%s;%s", name->Data(), nx, ny), bx[0], rx[0][0], rx[0][1],
-                         bx[1], rx[1][0], rx[1][1]);
-        ++(* idx);
-        return 0;
-    }
-
-    for (int bbi = 0; bbi < bbx[depth]; ++bbi) {
+// Variable computed from the ntuple columns and the derived variables before it.
+typedef struct {
+    TString    name;
+    expression expr;
+} derived_var;
+
+// Binning dimension. var is split in nbins uniform bins of width interval, from rx[0] to rx[1].
+typedef struct {
+    int    var;
+    double rx[2];
+    long   nbins;
+    double interval;
+} bin_dim;
+
+// 1D (type 0) or 2D (type 1) plot of variables vx, with ranges rx and bx bins along each axis.
+typedef struct {
+    int     type;
+    int     vx[2];
+    double  rx[2][2];
+    long    bx[2];
+    TString name;
+    bool    dis_var[2]; // If vx is in DIS_LIST, set by prepare_plot_setup().
+} plot_def;
+
+// Cuts, binning, and plots of one analysis, set up by the user or read from a config file. Shared
+//     read-only by all fill workers.
+typedef struct {
+    TString out_filename;
+    int  trk;
+    int  p_charge; // INT_MAX if not cutting on charge.
+    int  p_pid;    // INT_MAX if not cutting on PID.
+    bool general_cuts;
+    bool geometry_cuts;
+    bool dis_cuts;
+    std::vector<bin_dim>  bins;
+    long                  plt_size; // Number of binning cells.
+    std::vector<plot_def> plots;
+    double                cell_mem; // Estimated memory taken by the plots of one cell, in bytes.
+    bool use_col[VAR_LIST_SIZE];    // Ntuple columns read, see find_columns().
+    std::vector<derived_var> derived; // Variables VAR_LIST_SIZE onwards, after the columns.
+    std::vector<expression>  cuts;    // Custom cuts, applied after the default ones.
+    bool per_row;                     // Apply the default cuts row by row, see fill_block().
+} plot_setup;
+
+// Plots of the binning cells populated so far, keyed by cell index. mem counts the memory of the
+//     plots of all grids filled under the same budget, so that it holds for all threads at once.
+//     fill_ns adds up the time spent cutting and filling rows by all threads, in nanoseconds.
+typedef struct {
+    std::map<long, std::vector<TH1 *>> cells;
+    std::atomic<long> *                mem;
+    std::atomic<long> *                fill_ns;
+} plot_grid;
+
+// Entries, events, and events passing the DIS cuts read from one run.
+typedef struct {
+    long nentries;
+    long nevents;
+    long nselected;
+} run_counts;
+
+// Counters of the events read from the ntuples, in total and by run number.
+typedef struct {
+    long nevents;
+    long nselected;
+    long nsplit;    // Extra groups of rows of events whose rows aren't contiguous.
+    long sel_bytes; // Memory taken by the event selection.
+    std::map<int, run_counts> runs;
+} event_counts;
+
+// Rows of consecutive events laid out by column, so that cuts run over contiguous arrays. Only the
+//     columns in use are copied. valid tells if the event of each row passes the DIS cuts.
+typedef struct {
+    std::vector<Float_t> cols;  // VAR_LIST_SIZE columns of cap rows each.
+    std::vector<uint8_t> valid;
+    std::vector<int>     use;   // Columns copied.
+    long                 cap;
+    long                 nrows;
+} row_block;
+
+// Ntuple opened by one worker, with its branches bound to vars and key.
+typedef struct {
+    TFile   * f;
+    TTree   * t;
+    Float_t   vars[VAR_LIST_SIZE];
+    Long64_t  key;
+    bool      has_key;
+} ntuple_reader;
+
+// Ntuples of one tracker read as a single chain, split in chunks of DRAW_CHUNK entries.
+typedef struct {
+    char **               files;
+    int                   nfiles;
+    int                   trk;
+    std::vector<Long64_t> nentries;    // Entries of each file.
+    std::vector<long>     first_chunk; // First chunk of each file, followed by the total.
+} ntuple_chain;
+
+// Events found in one chunk by the selection pass.
+typedef struct {
+    evn_selection       seen;     // Events with rows in the chunk.
+    evn_selection       selected; // Events whose trigger electron passes the DIS cuts.
+    long                ngroups;  // Groups of contiguous rows of the same event.
+    std::map<int, long> nentries; // Rows of each run.
+} chunk_events;
+
+// Initialize event counters.
+event_counts event_counts_init() {
+    event_counts c;
+    c.nevents   = 0;
+    c.nselected = 0;
+    c.nsplit    = 0;
+    c.sel_bytes = 0;
+    return c;
+}
+
+// Initialize an empty row block, copying the columns used by any of the ns analyses s. It has room
+//     for a few more than DRAW_BLOCK rows, so that events can be completed before it's filled.
+row_block row_block_init(plot_setup ** s, int ns) {
+    row_block b;
+    b.cap   = 2 * DRAW_BLOCK;
+    b.nrows = 0;
+    b.cols .resize(VAR_LIST_SIZE * b.cap);
+    b.valid.resize(b.cap);
+    for (int vi = 0; vi < VAR_LIST_SIZE; ++vi) {
+        bool used = false;
+        for (int si = 0; si < ns; ++si) used = used || s[si]->use_col[vi];
+        if (used) b.use.push_back(vi);
+    }
+    return b;
+}
+
+// Append a row to a block, doubling its capacity if it's full.
+int row_block_append(row_block * b, const Float_t vars[VAR_LIST_SIZE]) {
+    if (b->nrows == b->cap) {
+        std::vector<Float_t> cols(VAR_LIST_SIZE * 2 * b->cap);
+        for (int vi : b->use) {
+            Float_t * col = &(b->cols[vi * b->cap]);
+            std::copy(col, col + b->nrows, &(cols[vi * 2 * b->cap]));
+        }
+        b->cols.swap(cols);
+        b->cap *= 2;
+        b->valid.resize(b->cap);
+    }
+
+    for (int vi : b->use) b->cols[vi * b->cap + b->nrows] = vars[vi];
+    b->nrows++;
+    return 0;
+}
+
+// Get the name of variable vi, which is either an ntuple column or a derived variable.
+const char * var_name(const plot_setup * s, int vi) {
+    return vi < VAR_LIST_SIZE ? S_VAR_LIST[vi] : s->derived[vi - VAR_LIST_SIZE].name.Data();
+}
+
+// Compile an expression over the ntuple columns and derived variables of s. Returns 1 if it's
+//     invalid.
+int compile_setup_expression(const plot_setup * s, const char * text, expression * e) {
+    std::vector<const char *> names(R_VAR_LIST, R_VAR_LIST + VAR_LIST_SIZE);
+    for (const derived_var &d : s->derived) names.push_back(d.name.Data());
+    return compile_expression(text, names.data(), names.size(), e);
+}
+
+// Find the ntuple columns needed by the cuts, binning, and plots of s. If all_cols is true, all of
+//     them are read instead.
+int find_columns(plot_setup * s, bool all_cols) {
+    bool * use = s->use_col;
+    for (int vi = 0; vi < VAR_LIST_SIZE; ++vi) use[vi] = all_cols;
+
+    if (s->p_charge != INT_MAX) use[A_CHARGE] = true;
+    if (s->p_pid    != INT_MAX) use[A_PID]    = true;
+    if (s->general_cuts) {
+        use[A_PID]  = true;
+        use[A_CHI2] = true;
+        use[A_NDF]  = true;
+    }
+    if (s->geometry_cuts) {
+        use[A_VX] = true;
+        use[A_VY] = true;
+        use[A_VZ] = true;
+    }
+    for (const derived_var &d : s->derived) expression_columns(&(d.expr), use, VAR_LIST_SIZE);
+    for (const expression &e : s->cuts) expression_columns(&e, use, VAR_LIST_SIZE);
+    for (const bin_dim &b : s->bins) if (b.var < VAR_LIST_SIZE) use[b.var] = true;
+    for (const plot_def &p : s->plots) {
+        for (int di = 0; di < p.type+1; ++di) if (p.vx[di] < VAR_LIST_SIZE) use[p.vx[di]] = true;
+    }
+
+    return 0;
+}
+
+// Open the ntuple of tracker trk from filename, reading only the columns in use_col. Values of the
+//     other columns are left at 0. Returns 1 if it can't be read.
+int open_ntuple(ntuple_reader * r, const char * filename, int trk,
+                const bool use_col[VAR_LIST_SIZE]) {
+    r->f = TFile::Open(filename, "READ");
+    if (!r->f || r->f->IsZombie()) return 1;
+    r->t = r->f->Get<TTree>(trk == A_DC ? S_DC : S_FMT);
+    if (r->t == NULL) return 1;
+
+    // (run, event) key of each row. Ntuples written before the R_EVNKEY branch existed are keyed by
+    //     their float run and event numbers instead, which are exact only up to 2^24.
+    r->key     = -1;
+    r->has_key = r->t->GetBranch(R_EVNKEY) != NULL;
+
+    r->t->SetBranchStatus("*", false);
+    for (int vi = 0; vi < VAR_LIST_SIZE; ++vi) {
+        r->vars[vi] = 0;
+        bool is_key = !r->has_key && (vi == A_RUNNO || vi == A_EVENTNO);
+        if (!use_col[vi] && !is_key) continue;
+        r->t->SetBranchStatus(S_VAR_LIST[vi], true);
+        r->t->SetBranchAddress(S_VAR_LIST[vi], &(r->vars[vi]));
+    }
+    if (r->has_key) {
+        r->t->SetBranchStatus(R_EVNKEY, true);
+        r->t->SetBranchAddress(R_EVNKEY, &(r->key));
+    }
+    return 0;
+}
+
+// Read entry i of an ntuple, storing its (run, event) key in key. Returns 6 if the entry has no
+//     valid key.
+int read_row(ntuple_reader * r, Long64_t i, Long64_t * key) {
+    r->t->GetEntry(i);
+    if (!r->has_key) {
+        long long k;
+        int       run_no = (int)       floor(r->vars[A_RUNNO]   + 0.5);
+        long long evn    = (long long) floor(r->vars[A_EVENTNO] + 0.5);
+        if (evn_key(run_no, evn, &k)) return 6;
+        r->key = k;
+    }
+    if (r->key < 0) return 6;
+    * key = r->key;
+    return 0;
+}
+
+// Book plot pi for binning cell idx, naming it after the cell's bin limits.
+TH1 * book_plt(const plot_setup * s, int pi, long idx) {
+    const plot_def * p = &(s->plots[pi]);
+    TString name = p->name;
+    long dim_factor = s->plt_size;
+    for (const bin_dim &b : s->bins) {
         // Find limits.
-        double b_low  = brx[depth][0] + b_interval[depth]* bbi;
-        double b_high = brx[depth][0] + b_interval[depth]*(bbi+1);
+        dim_factor /= b.nbins;
+        long   bbi    = (idx/dim_factor) % b.nbins;
+        double b_low  = b.rx[0] + b.interval* bbi;
+        double b_high = b.rx[0] + b.interval*(bbi+1);
 
         // Append bin limits to name.
-        TString name_cpy = name->Copy();
-        name_cpy.Append(Form(" (%s: %6.2f, %6.2f)", S_VAR_LIST[bvx[depth]], b_low, b_high));
+        name.Append(Form(" (%s: %6.2f, %6.2f)", var_name(s, b.var), b_low, b_high));
+    }
+
+    const char * nx = var_name(s, p->vx[0]);
+    if (p->type == 0)
+        return new TH1F(name, Form("%s;%s", name.Data(), nx), p->bx[0], p->rx[0][0], p->rx[0][1]);
+    return new TH2F(name, Form("%s;%s;%s", name.Data(), nx, var_name(s, p->vx[1])),
+                    p->bx[0], p->rx[0][0], p->rx[0][1], p->bx[1], p->rx[1][0], p->rx[1][1]);
+}
+
+// Get the output directory of binning cell idx.
+int find_bin(const plot_setup * s, long idx, TString * name) {
+    long dim_factor = s->plt_size;
+    for (const bin_dim &b : s->bins) {
+        // Find index in array (for this dimension).
+        dim_factor /= b.nbins;
+        long bi = (idx/dim_factor) % b.nbins;
 
-        // Continue down the line.
-        name_plt(plt, &name_cpy, nx, ny, idx, dbins, depth+1, px, bx, rx, bvx, bbx, brx, b_interval);
+        // Get limits.
+        double low  = b.rx[0] + b.interval* bi;
+        double high = b.rx[0] + b.interval*(bi+1);
+
+        // Append dir to name.
+        name->Append(Form("%s (%6.2f, %6.2f)/", var_name(s, b.var), low, high));
     }
 
     return 0;
 }
 
-int find_bin(TString * name, int plt_size, int idx, long dbins, long depth, int prev_dim_factor,
-             int vx[], long bx[], double rx[][2], double interval[]) {
-    if (depth == dbins) return 0;
+// Find the binning cell of row ri, given the columns of all variables, or -1 if any binning
+//     variable is out of range. Bins are uniform, so each dimension's bin is computed directly and
+//     then nudged by one if rounding put the value on the wrong side of an edge. Values exactly on
+//     an edge are left out.
+long find_idx(const plot_setup * s, const Float_t * const cols[], long ri) {
+    long idx = 0;
+    for (const bin_dim &b : s->bins) {
+        Float_t var = cols[b.var][ri];
+        if (!(b.rx[0] < var && var < b.rx[1])) return -1;
+        long bi = (long) ((var - b.rx[0]) / b.interval);
+        if (bi >= b.nbins) bi = b.nbins - 1;
+        if      (bi > 0         && var <= b.rx[0] + b.interval* bi)    bi--;
+        else if (bi < b.nbins-1 && var >= b.rx[0] + b.interval*(bi+1)) bi++;
 
-    // Find index in array (for this dimension).
-    int dim_factor = 1;
-    for (int di = depth+1; di < dbins; ++di) dim_factor *= bx[di];
-    int bi = (idx%prev_dim_factor)/dim_factor;
+        // Check bin limits.
+        double low  = b.rx[0] + b.interval* bi;
+        double high = b.rx[0] + b.interval*(bi+1);
+        if (!(low < var && var < high)) return -1;
+        idx = idx*b.nbins + bi;
+    }
 
-    // Get limits.
-    double low  = rx[depth][0] + interval[depth]* bi;
-    double high = rx[depth][0] + interval[depth]*(bi+1);
+    return idx;
+}
 
-    // Append dir to name.
-    name->Append(Form("%s (%6.2f, %6.2f)/", S_VAR_LIST[vx[depth]], low, high));
+// Estimate the memory taken by one plot, in bytes. Under- and overflow bins are included, and
+//     ROOT's own overhead is taken as 1 kB per histogram.
+double plt_bytes(const plot_def * p) {
+    double ncells = p->bx[0] + 2;
+    if (p->type == 1) ncells *= p->bx[1] + 2;
+    return ncells * sizeof(Float_t) + 1024;
+}
 
-    return find_bin(name, plt_size, idx, dbins, depth+1, dim_factor, vx, bx, rx, interval);
+// Keep the rows in sel[0, nsel) that pass a cut, in order, returning how many are left. Rows are
+//     kept without branching, so that each cut is a tight loop over the rows still selected.
+template <typename F> long keep_rows(long * sel, long nsel, F pass) {
+    long kept = 0;
+    for (long ki = 0; ki < nsel; ++ki) {
+        sel[kept] = sel[ki];
+        kept     += pass(sel[ki]);
+    }
+    return kept;
 }
 
-// Find index of plot in array, recursively going through binnings.
-int find_idx(long dbins, long depth, Float_t var[], long bx[], double rx[][2], double interval[]) {
-    if (depth == dbins) return 0;
-    for (int bi = 0; bi < bx[depth]; ++bi) {
-        // Define bin limits.
-        double low  = rx[depth][0] + interval[depth]* bi;
-        double high = rx[depth][0] + interval[depth]*(bi+1);
+// Tell if row ri of a block passes the default cuts of s, checking them in turn and stopping at the
+//     first one failed. This is how rows were cut before the cuts ran over whole columns, and it's
+//     kept so that both can be compared on the same ntuples with draw_plots -r.
+bool pass_default_cuts(const plot_setup * s, const row_block * blk, long ri) {
+    const Float_t * c   = blk->cols.data();
+    long            cap = blk->cap;
+    auto col = [&](int vi) {return c[vi * cap + ri];};
+
+    // Apply particle cuts.
+    if (s->p_charge ==  1 && !(col(A_CHARGE) >  0)) return false;
+    if (s->p_charge ==  0 && !(col(A_CHARGE) == 0)) return false;
+    if (s->p_charge == -1 && !(col(A_CHARGE) <  0)) return false;
+    if (s->p_pid != INT_MAX && col(A_PID) != s->p_pid) return false;
+
+    // Apply other cuts.
+    if (s->general_cuts) {
+        if (-0.5 < col(A_PID) && col(A_PID) <  0.5) return false; // Non-identified particle.
+        if (44.5 < col(A_PID) && col(A_PID) < 45.5) return false; // Non-identified particle.
+        if (col(A_CHI2)/col(A_NDF) >= CHI2NDFCUT)   return false; // Ignore high chi2 tracks.
+    }
+    if (s->geometry_cuts) {
+        if (calc_magnitude(col(A_VX), col(A_VY)) > VXVYCUT)   return false;
+        if (VZLOWCUT > col(A_VZ) || col(A_VZ) > VZHIGHCUT) return false;
+    }
+    if (s->dis_cuts && !blk->valid[ri]) return false;
+
+    return true;
+}
 
-        // Find bin for var.
-        if (low < var[depth] && var[depth] < high) {
-            int dim_factor = 1;
-            for (int di = depth+1; di < dbins; ++di) dim_factor *= bx[di];
-            return bi*dim_factor + find_idx(dbins, depth+1, var, bx, rx, interval);
+// Compute the derived variables of a block, apply cuts to its rows, and fill them. Each cut runs
+//     over its columns, narrowing down a list of selected rows, and only the rows left are filled.
+//     If s->per_row is set, the default cuts are applied row by row by pass_default_cuts()
+//     instead. Returns 2 if booking a new cell would take the memory of the grid's budget past
+//     PLT_MAXMB.
+int fill_block(const plot_setup * s, plot_grid * g, const row_block * blk) {
+    long            cap    = blk->cap;
+    const Float_t * c      = blk->cols.data();
+    const Float_t * charge = &(c[A_CHARGE * cap]);
+    const Float_t * pid    = &(c[A_PID    * cap]);
+    const Float_t * chi2   = &(c[A_CHI2   * cap]);
+    const Float_t * ndf    = &(c[A_NDF    * cap]);
+    const Float_t * vx     = &(c[A_VX     * cap]);
+    const Float_t * vy     = &(c[A_VY     * cap]);
+    const Float_t * vz     = &(c[A_VZ     * cap]);
+    const uint8_t * valid  = blk->valid.data();
+
+    std::vector<long> sel(blk->nrows);
+    long nsel = blk->nrows;
+    for (long ri = 0; ri < nsel; ++ri) sel[ri] = ri;
+    long * sl = sel.data();
+
+    if (s->per_row) {
+        nsel = keep_rows(sl, nsel, [&](long ri) {return pass_default_cuts(s, blk, ri);});
+    }
+    else {
+        // Apply particle cuts.
+        if (s->p_charge ==  1) nsel = keep_rows(sl, nsel, [&](long ri) {return charge[ri] >  0;});
+        if (s->p_charge ==  0) nsel = keep_rows(sl, nsel, [&](long ri) {return charge[ri] == 0;});
+        if (s->p_charge == -1) nsel = keep_rows(sl, nsel, [&](long ri) {return charge[ri] <  0;});
+        if (s->p_pid != INT_MAX) {
+            nsel = keep_rows(sl, nsel, [&](long ri) {return pid[ri] == s->p_pid;});
+        }
+
+        // Apply other cuts.
+        if (s->general_cuts) {
+            nsel = keep_rows(sl, nsel, [&](long ri) {
+                return !(-0.5 < pid[ri] && pid[ri] <  0.5) // Non-identified particle.
+                    && !(44.5 < pid[ri] && pid[ri] < 45.5) // Non-identified particle.
+                    && !(chi2[ri]/ndf[ri] >= CHI2NDFCUT);  // Ignore high chi2 tracks.
+            });
+        }
+
+        if (s->geometry_cuts) {
+            nsel = keep_rows(sl, nsel, [&](long ri) {
+                return !(calc_magnitude(vx[ri], vy[ri]) > VXVYCUT)
+                    && !(VZLOWCUT > vz[ri] || vz[ri] > VZHIGHCUT);
+            });
+        }
+
+        if (s->dis_cuts) nsel = keep_rows(sl, nsel, [&](long ri) {return valid[ri] != 0;});
+    }
+
+    // Compute derived variables over all rows, since their expressions run over whole columns.
+    std::vector<const Float_t *> vars(VAR_LIST_SIZE + s->derived.size());
+    for (int vi = 0; vi < VAR_LIST_SIZE; ++vi) vars[vi] = &(c[vi * cap]);
+    std::vector<Float_t> derived(s->derived.size() * blk->nrows);
+    std::vector<Float_t> scratch;
+    for (UInt_t di = 0; di < s->derived.size(); ++di) {
+        Float_t * d = &(derived[di * blk->nrows]);
+        eval_expression(&(s->derived[di].expr), vars.data(), blk->nrows, d, &scratch);
+        vars[VAR_LIST_SIZE + di] = d;
+    }
+
+    // Apply custom cuts.
+    std::vector<Float_t> pass(s->cuts.empty() ? 0 : blk->nrows);
+    for (const expression &e : s->cuts) {
+        eval_expression(&e, vars.data(), blk->nrows, pass.data(), &scratch);
+        nsel = keep_rows(sl, nsel, [&](long ri) {return pass[ri] != 0;});
+    }
+
+    for (long ki = 0; ki < nsel; ++ki) {
+        long ri = sl[ki];
+
+        // Find corresponding bin, shared by all plots.
+        long idx = find_idx(s, vars.data(), ri);
+        if (idx == -1) continue;
+
+        // Book cell if it's the first time it's filled.
+        std::map<long, std::vector<TH1 *>>::iterator cell = g->cells.find(idx);
+        if (cell == g->cells.end()) {
+            long cell_mem = (long) s->cell_mem;
+            if (g->mem->fetch_add(cell_mem) + cell_mem > PLT_MAXMB * 1e6) {
+                g->mem->fetch_sub(cell_mem);
+                return 2;
+            }
+            cell = g->cells.insert({idx, std::vector<TH1 *>()}).first;
+            for (UInt_t pi = 0; pi < s->plots.size(); ++pi)
+                cell->second.push_back(book_plt(s, pi, idx));
+        }
+
+        for (UInt_t pi = 0; pi < s->plots.size(); ++pi) {
+            const plot_def * p = &(s->plots[pi]);
+
+            // SIDIS variables only make sense for some particles.
+            bool sidis_pass = true;
+            for (int di = 0; di < p->type+1; ++di) {
+                if (p->dis_var[di] && vars[p->vx[di]][ri] < 1e-9) sidis_pass = false;
+            }
+            if (!sidis_pass) continue;
+
+            // Fill histogram.
+            TH1 * h = cell->second[pi];
+            if (p->type == 0) h->Fill(vars[p->vx[0]][ri]);
+            if (p->type == 1) h->Fill(vars[p->vx[0]][ri], vars[p->vx[1]][ri]);
         }
     }
 
-    return -1; // Variable is not within binning range.
+    return 0;
 }
 
-int run() {
-    // Open input file.
-    TFile * f_in  = TFile::Open("../root_io/ntuples.root", "READ"); // NOTE. This path sucks.
+// Fill the rows of a block into the grids g of the ns analyses s, and empty it. The time taken is
+//     added to the fill_ns of each grid.
+int flush_block(plot_setup ** s, int ns, plot_grid * g, row_block * blk) {
+    for (int si = 0; si < ns; ++si) {
+        struct timespec t0, t1;
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        int chk = fill_block(s[si], &(g[si]), blk);
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        * g[si].fill_ns += (t1.tv_sec - t0.tv_sec)*1000000000L + (t1.tv_nsec - t0.tv_nsec);
+        if (chk) return chk;
+    }
+    blk->nrows = 0;
+    return 0;
+}
 
-    if (!f_in || f_in->IsZombie()) return 1;
+// Fill the events that start between entries first and last of an ntuple into the grids g of the
+//     ns analyses s. Rows are grouped by event, so each event's rows are buffered in a block until
+//     the event key changes, and the block is filled once it holds DRAW_BLOCK rows so that each
+//     entry is read only once for all analyses. An event passes the DIS cuts if it's in selected,
+//     found beforehand from the whole chain. The rows of an event that started before first are
+//     skipped, and the rows of the last event are read past last. Returns 6 if a row has no valid
+//     key.
+int fill_chunk(plot_setup ** s, int ns, ntuple_reader * r, Long64_t first, Long64_t last,
+               plot_grid * g, const evn_selection * selected) {
+    row_block blk         = row_block_init(s, ns);
+    long      evn_first   = 0; // First row of the buffered event in blk.
+    Long64_t  nentries    = r->t->GetEntries();
+    Long64_t  current_key = -1;
+    if (first > 0 && read_row(r, first-1, &current_key)) return 6;
+    bool      skipping    = first > 0;
+    for (Long64_t i = first; i <= nentries; ++i) {
+        Long64_t key = -1;
+        if (i < nentries) {
+            if (read_row(r, i, &key)) return 6;
+            if (key == current_key) {
+                if (!skipping) row_block_append(&blk, r->vars);
+                continue;
+            }
+        }
+        skipping = false;
 
-    // NOTE. This function could receive a few arguments to speed IO up. Pre-configured cuts,
-    //       binnings, and corrections would be nice.
-    // TODO. Prepare corrections (acceptance, radiative, Feynman, etc...).
+        // Apply the DIS selection to the buffered event.
+        if (blk.nrows > evn_first) {
+            bool valid_event = evn_selection_get(selected, current_key);
+            for (long ri = evn_first; ri < blk.nrows; ++ri) blk.valid[ri] = valid_event;
+            if (blk.nrows >= DRAW_BLOCK) {
+                int chk = flush_block(s, ns, g, &blk);
+                if (chk) return chk;
+            }
+        }
+
+        // Start buffering the next event, unless it belongs to the next chunk.
+        evn_first = blk.nrows;
+        if (i >= last || i == nentries) break;
+        current_key = key;
+        row_block_append(&blk, r->vars);
+    }
+
+    return flush_block(s, ns, g, &blk);
+}
+
+// Find the events that start between entries first and last of an ntuple, and which of them have a
+//     trigger electron passing the DIS cuts if dis_cuts is true. Chunk boundaries are handled as in
+//     fill_chunk(), so that an event split between chunks is only counted as split if its rows
+//     aren't contiguous. Returns 6 if a row has no valid key.
+int select_chunk(ntuple_reader * r, Long64_t first, Long64_t last, bool dis_cuts,
+                 chunk_events * ce) {
+    Long64_t  nentries    = r->t->GetEntries();
+    Long64_t  current_key = -1;
+    if (first > 0 && read_row(r, first-1, &current_key)) return 6;
+    bool      skipping    = first > 0;
+    int       current_run = -1;
+    long *    run_rows    = NULL;
+    const Float_t * v     = r->vars;
+    ce->ngroups = 0;
+    for (Long64_t i = first; i < nentries; ++i) {
+        Long64_t key;
+        if (read_row(r, i, &key)) return 6;
+        if (key != current_key) {
+            if (i >= last) break; // Next chunk's event.
+            skipping    = false;
+            current_key = key;
+            ce->ngroups++;
+            evn_selection_set(&(ce->seen), key, true);
+            if (evn_key_run(key) != current_run) {
+                current_run = evn_key_run(key);
+                run_rows    = &(ce->nentries[current_run]);
+            }
+        }
+        if (skipping) continue;
+        (* run_rows)++;
+
+        if (!dis_cuts || v[A_PID] != 11 || v[A_STATUS] > 0) continue;
+        if (v[A_Q2] >= Q2CUT && v[A_W2] >= W2CUT) evn_selection_set(&(ce->selected), key, true);
+    }
+
+    return 0;
+}
+
+// Add the plots of src to dst, taking the cells dst doesn't have. src is left empty.
+int merge_plot_grid(plot_grid * dst, plot_grid * src) {
+    for (std::pair<const long, std::vector<TH1 *>> &cell : src->cells) {
+        std::map<long, std::vector<TH1 *>>::iterator it = dst->cells.find(cell.first);
+        if (it == dst->cells.end()) {
+            dst->cells.insert({cell.first, cell.second});
+            continue;
+        }
+        for (UInt_t pi = 0; pi < cell.second.size(); ++pi) {
+            it->second[pi]->Add(cell.second[pi]);
+            delete cell.second[pi];
+        }
+    }
+    src->cells.clear();
+    return 0;
+}
 
+// Delete all plots in a grid.
+int free_plot_grid(plot_grid * g) {
+    for (std::pair<const long, std::vector<TH1 *>> &cell : g->cells) {
+        for (TH1 * h : cell.second) delete h;
+    }
+    g->cells.clear();
+    return 0;
+}
+
+// Ask the user for the cuts, binning, and plots of one analysis.
+int ask_plot_setup(plot_setup * s) {
     // === CUT SETUP ===============================================================================
     printf("\nUse DC or FMT data? [");
     for (int ti = 0; ti < TRK_LIST_SIZE; ++ti) printf("%s, ", TRK_LIST[ti]);
     printf("\b\b]\n");
-    int trk = catch_string(TRK_LIST, TRK_LIST_SIZE);
+    s->trk = catch_string(TRK_LIST, TRK_LIST_SIZE);
 
     printf("\nWhat particle should be plotted? Available cuts:\n[");
     for (int pi = 0; pi < PART_LIST_SIZE; ++pi) printf("%s, ", PART_LIST[pi]);
     printf("\b\b]\n");
     int part = catch_string(PART_LIST, PART_LIST_SIZE);
-    int p_charge = INT_MAX;
-    int p_pid    = INT_MAX;
-    if      (part == A_PPOS) p_charge =  1;
-    else if (part == A_PNEU) p_charge =  0;
-    else if (part == A_PNEG) p_charge = -1;
+    s->p_charge = INT_MAX;
+    s->p_pid    = INT_MAX;
+    if      (part == A_PPOS) s->p_charge =  1;
+    else if (part == A_PNEU) s->p_charge =  0;
+    else if (part == A_PNEG) s->p_charge = -1;
     else if (part == A_PPID) {
         printf("\nSelect PID from [");
-        for (std::map<int, double>::const_iterator it = MASS.begin(); it != MASS.end(); ++it)
-            printf("%d, ", it->first);
+        for (int ti = 0; ti < PID_TABLE_SIZE; ++ti) printf("%d, ", PID_TABLE[ti].pid);
         printf("\b\b]\n");
-        p_pid = catch_long();
+        s->p_pid = catch_long();
     }
 
-    char * outfilename = p_pid == INT_MAX ?
-            Form("../root_io/plots_%s_%s.root", TRK_LIST[trk], PART_LIST[part]) :
-            Form("../root_io/plots_%s_pid%d.root", TRK_LIST[trk], p_pid);
+    // NOTE. This path sucks.
+    s->out_filename = s->p_pid == INT_MAX ?
+            Form("../root_io/plots_%s_%s.root", TRK_LIST[s->trk], PART_LIST[part]) :
+            Form("../root_io/plots_%s_pid%d.root", TRK_LIST[s->trk], s->p_pid);
 
-    // Open output file (NOTE. This path sucks).
-    TFile * f_out = TFile::Open(outfilename, "RECREATE");
-
-    bool general_cuts  = false;
-    bool geometry_cuts = false;
-    bool dis_cuts      = false;
+    s->general_cuts  = false;
+    s->geometry_cuts = false;
+    s->dis_cuts      = false;
     printf("\nApply all default cuts (general, geometry, DIS)? [y/n]\n");
     if (!catch_yn()) {
         printf("\nApply general cuts? [y/n]\n");
-        general_cuts = catch_yn();
+        s->general_cuts = catch_yn();
         printf("\nApply geometry cuts? [y/n]\n");
-        geometry_cuts = catch_yn();
+        s->geometry_cuts = catch_yn();
         printf("\nApply DIS cuts? [y/n]\n");
-        dis_cuts = catch_yn();
+        s->dis_cuts = catch_yn();
     }
     else {
-        general_cuts  = true;
-        geometry_cuts = true;
-        dis_cuts      = true;
+        s->general_cuts  = true;
+        s->geometry_cuts = true;
+        s->dis_cuts      = true;
     }
 
-    // TODO.
-    // printf("\nApply any custom cut? [y/n]\n");
-    // bool custom_cuts = catch_yn();
+    printf("\nApply any custom cut? [y/n]\n");
+    while (catch_yn()) {
+        printf("\nWrite the cut, such as \"p > 1 && abs(vz) < 5\". Available vars:\n[");
+        for (int vi = 0; vi < VAR_LIST_SIZE; ++vi) printf("%s, ", R_VAR_LIST[vi]);
+        printf("\b\b]\n");
+        expression cut;
+        while (true) {
+            char str[1024];
+            catch_line(str, sizeof(str));
+            if (!compile_setup_expression(s, str, &cut) && cut.type == EXPR_BOOL) break;
+            printf("Invalid cut. Try again.\n");
+        }
+        s->cuts.push_back(cut);
+        printf("\nApply another custom cut? [y/n]\n");
+    }
 
     // === BINNING SETUP ===========================================================================
     printf("\nNumber of dimensions for binning?\n");
-    long   dbins = catch_long();
-    int    bvx[dbins];
-    double brx[dbins][2];
-    double b_interval[dbins];
-    long   bbx[dbins];
+    long dbins = catch_long();
+    s->bins.resize(dbins);
     for (long bdi = 0; bdi < dbins; ++bdi) {
+        bin_dim * b = &(s->bins[bdi]);
+
         // variable.
         printf("\nDefine var for bin in dimension %ld. Available vars:\n[", bdi);
         for (int vi = 0; vi < VAR_LIST_SIZE; ++vi) printf("%s, ", R_VAR_LIST[vi]);
         printf("\b\b]\n");
-        bvx[bdi] = catch_string(R_VAR_LIST, VAR_LIST_SIZE);
+        b->var = catch_string(R_VAR_LIST, VAR_LIST_SIZE);
 
         // range.
         for (int ri = 0; ri < 2; ++ri) {
             printf("\nDefine %s limit for bin in dimension %ld:\n", RAN_LIST[ri], bdi);
-            brx[bdi][ri] = catch_double();
+            b->rx[ri] = catch_double();
         }
 
         // nbins.
         printf("\nDefine number of bins for bin in dimension %ld:\n", bdi);
-        bbx[bdi] = catch_long();
-
-        // binning interval.
-        b_interval[bdi] = (brx[bdi][1] - brx[bdi][0])/bbx[bdi];
+        b->nbins = catch_long();
     }
 
     // === PLOT SETUP ==============================================================================
@@ -206,175 +733,655 @@ int run() {
     printf("\nDefine number of plots (Set to 0 to just draw standard plots).\n");
     long pn = catch_long();
 
-    bool stdplt = false;
-    if (pn == 0) {
-        stdplt = true;
-        pn     = STDPLT_LIST_SIZE;
-    }
+    s->plots.resize(pn);
+    for (long pi = 0; pi < pn; ++pi) {
+        plot_def * p = &(s->plots[pi]);
 
-    int    px[pn];
-    int    vx[pn][2];
-    double rx[pn][2][2];
-    long   bx[pn][2];
-    for (long pi = 0; pi < pn && !stdplt; ++pi) {
         // Check if we are to make a 1D or 2D plot.
         printf("\nPlot %ld type? [", pi);
         for (int vi = 0; vi < PLOT_LIST_SIZE; ++vi) printf("%s, ", PLOT_LIST[vi]);
         printf("\b\b]:\n");
-        px[pi] = catch_string(PLOT_LIST, PLOT_LIST_SIZE);
+        p->type = catch_string(PLOT_LIST, PLOT_LIST_SIZE);
 
-        for (int di = 0; di < px[pi]+1; ++di) {
+        for (int di = 0; di < p->type+1; ++di) {
             // Check variable(s) to be plotted.
             printf("\nDefine var to be plotted on the %s axis. Available vars:\n[", DIM_LIST[di]);
             for (int vi = 0; vi < VAR_LIST_SIZE; ++vi) printf("%s, ", R_VAR_LIST[vi]);
             printf("\b\b]\n");
-            vx[pi][di] = catch_string(R_VAR_LIST, VAR_LIST_SIZE);
+            p->vx[di] = catch_string(R_VAR_LIST, VAR_LIST_SIZE);
 
             // Define ranges.
             for (int ri = 0; ri < 2; ++ri) {
                 printf("\nDefine %s limit for %s axis:\n", RAN_LIST[ri], DIM_LIST[di]);
-                rx[pi][di][ri] = catch_double();
+                p->rx[di][ri] = catch_double();
             }
 
             // Define number of bins in plot.
             printf("\nDefine number of bins for %s axis:\n", DIM_LIST[di]);
-            bx[pi][di] = catch_long();
+            p->bx[di] = catch_long();
         }
     }
-    if (stdplt) { // Setup standard plots.
-        memcpy(px, STD_PX, sizeof px);
-        memcpy(vx, STD_VX, sizeof vx);
-        memcpy(rx, STD_RX, sizeof rx);
-        memcpy(bx, STD_BX, sizeof bx);
-    }
 
-    // === NTUPLES SETUP ===========================================================================
-    TNtuple * t = (TNtuple *) f_in->Get(trk == 0 ? S_DC : S_FMT);
-    Float_t vars[VAR_LIST_SIZE];
-    for (int vi = 0; vi < VAR_LIST_SIZE; ++vi) t->SetBranchAddress(S_VAR_LIST[vi], &vars[vi]);
+    return 0;
+}
 
-    // === APPLY CUTS ==============================================================================
-    // Apply SIDIS cuts, checking which event numbers should be skipped.
-    // int nruns   =  1; // TODO.
-    int nevents = -1;
-    // Count number of events. NOTE. There's probably a cleaner way to do this.
-    for (int i = 0; i < t->GetEntries(); ++i) {
-        t->GetEntry(i);
-        if (vars[A_EVENTNO] > nevents) nevents = (int) (vars[A_EVENTNO]+0.5);
+// Append the standard plots to an analysis.
+int add_std_plots(plot_setup * s) {
+    for (int pi = 0; pi < STDPLT_LIST_SIZE; ++pi) {
+        plot_def p;
+        p.type = STD_PX[pi];
+        memcpy(p.vx, STD_VX[pi], sizeof p.vx);
+        memcpy(p.rx, STD_RX[pi], sizeof p.rx);
+        memcpy(p.bx, STD_BX[pi], sizeof p.bx);
+        s->plots.push_back(p);
     }
+    return 0;
+}
 
-    bool valid_event[nevents];
-    Float_t current_evn = -1;
-    bool no_tre_pass, Q2_pass, W2_pass;
-    for (int i = 0; i < t->GetEntries(); ++i) {
-        t->GetEntry(i);
-        if (vars[A_EVENTNO] != current_evn) {
-            current_evn = vars[A_EVENTNO];
-            valid_event[(int) (vars[A_EVENTNO]+0.5)] = false;
-            no_tre_pass = false;
-            Q2_pass     = true;
-            W2_pass     = true;
-        }
+// Initialize an analysis with no cuts, binning, or plots, reading DC data.
+plot_setup plot_setup_init() {
+    plot_setup s;
+    s.trk           = A_DC;
+    s.p_charge      = INT_MAX;
+    s.p_pid         = INT_MAX;
+    s.general_cuts  = false;
+    s.geometry_cuts = false;
+    s.dis_cuts      = false;
+    s.per_row       = false;
+    return s;
+}
 
-        if (vars[A_PID] != 11 || vars[A_STATUS] > 0) continue;
-        no_tre_pass = true;
-        Q2_pass = vars[A_Q2] >= Q2CUT;
-        W2_pass = vars[A_W2] >= W2CUT;
+// Read a range and number of bins from the tokens after the current strtok() position. Returns
+//     false if they're missing or invalid.
+bool read_config_range(double rx[2], long * nbins) {
+    char * tok[3];
+    for (int ti = 0; ti < 3; ++ti) {
+        tok[ti] = strtok(NULL, " \t\n");
+        if (tok[ti] == NULL) return false;
+    }
+
+    char * end[3];
+    rx[0]  = strtod(tok[0], &(end[0]));
+    rx[1]  = strtod(tok[1], &(end[1]));
+    * nbins = strtol(tok[2], &(end[2]), 10);
+    for (int ti = 0; ti < 3; ++ti) if (* end[ti] != '\0') return false;
+    return rx[0] < rx[1] && * nbins > 0;
+}
 
-        valid_event[(int) (vars[A_EVENTNO]+0.5)] = no_tre_pass && Q2_pass && W2_pass;
+// Find a variable by name, returning its index in R_VAR_LIST or after it for the derived variables
+//     of s, or -1 if there's none.
+int find_var(const plot_setup * s, const char * name) {
+    int vi = find_string(R_VAR_LIST, VAR_LIST_SIZE, name);
+    for (UInt_t di = 0; di < s->derived.size() && vi == -1; ++di) {
+        if (s->derived[di].name == name) vi = VAR_LIST_SIZE + di;
     }
+    return vi;
+}
 
-    // === PLOT ====================================================================================
-    // Create plots, separated by n-dimensional binning.
-    long plt_size = 1;
-    for (int bdi = 0; bdi < dbins; ++bdi) plt_size *= bbx[bdi];
+// Read a variable name from the token after the current strtok() position, returning its index as
+//     in find_var() or -1 if it's missing or invalid.
+int read_config_var(const plot_setup * s) {
+    char * tok = strtok(NULL, " \t\n");
+    return tok == NULL ? -1 : find_var(s, tok);
+}
+
+// Read the analyses in a config file. Each line holds a keyword followed by its values, and
+//     everything after a '#' is ignored:
+//     * analysis NAME: Start a new analysis, written to ../root_io/plots_NAME.root.
+//     * tracker TRK: dc or fmt. Default is dc.
+//     * particle PART [PID]: One of PART_LIST, followed by a PID if PART is pid. Default is all.
+//     * cuts CUT [...]: Any of general, geometry, and dis. Default is no cuts.
+//     * cut EXPR: Add a custom cut, such as `p > 1 && abs(vz) < 5`. See expression.h.
+//     * define NAME EXPR: Add a derived variable, usable by later expressions, bins, and plots.
+//     * bin VAR LOWER UPPER NBINS: Add a binning dimension.
+//     * plot 1d VAR LOWER UPPER NBINS: Add a 1D plot.
+//     * plot 2d VARX LOWER UPPER NBINS VARY LOWER UPPER NBINS: Add a 2D plot.
+//     * plot std: Add the standard plots. Analyses without plots get them too.
+//     Each analysis needs a unique NAME, since it names its output file. Returns 3 if the file
+//     can't be opened, 4 if a line is invalid, or 7 if a line is longer than DRAW_LINELEN, with
+//     its number in bad_line.
+int read_plot_config(const char * filename, std::vector<plot_setup> * setups, int * bad_line) {
+    FILE * f = fopen(filename, "r");
+    if (f == NULL) return 3;
+
+    char line[DRAW_LINELEN + 2]; // Room for the newline and the terminating null.
+    * bad_line = 0;
+    while (fgets(line, sizeof(line), f) != NULL) {
+        (* bad_line)++;
+        if (strchr(line, '\n') == NULL && !feof(f)) {
+            fclose(f);
+            return 7;
+        }
+        char * comment = strchr(line, '#');
+        if (comment != NULL) * comment = '\0';
+        char * key = strtok(line, " \t\n");
+        if (key == NULL) continue;
+
+        bool valid = true;
+        if (!strcmp(key, "analysis")) {
+            char * name = strtok(NULL, " \t\n");
+            valid = name != NULL;
+            TString out_filename = Form("../root_io/plots_%s.root", valid ? name : "");
+            for (const plot_setup &s : * setups) {
+                if (s.out_filename == out_filename) valid = false;
+            }
+            if (valid) {
+                setups->push_back(plot_setup_init());
+                setups->back().out_filename = out_filename;
+            }
+        }
+        else if (setups->empty()) {
+            valid = false; // Everything else belongs to an analysis.
+        }
+        else if (!strcmp(key, "tracker")) {
+            char * tok = strtok(NULL, " \t\n");
+            int trk = tok == NULL ? -1 : find_string(TRK_LIST, TRK_LIST_SIZE, tok);
+            valid = trk != -1;
+            if (valid) setups->back().trk = trk;
+        }
+        else if (!strcmp(key, "particle")) {
+            plot_setup * s = &(setups->back());
+            char * tok = strtok(NULL, " \t\n");
+            int part = tok == NULL ? -1 : find_string(PART_LIST, PART_LIST_SIZE, tok);
+            valid = part != -1;
+            s->p_charge = INT_MAX;
+            s->p_pid    = INT_MAX;
+            if      (part == A_PPOS) s->p_charge =  1;
+            else if (part == A_PNEU) s->p_charge =  0;
+            else if (part == A_PNEG) s->p_charge = -1;
+            else if (part == A_PPID) {
+                tok = strtok(NULL, " \t\n");
+                char * end;
+                if (tok != NULL) s->p_pid = strtol(tok, &end, 10);
+                valid = tok != NULL && * end == '\0';
+            }
+        }
+        else if (!strcmp(key, "cuts")) {
+            plot_setup * s = &(setups->back());
+            for (char * tok = strtok(NULL, " \t\n"); tok != NULL; tok = strtok(NULL, " \t\n")) {
+                if      (!strcmp(tok, "general"))  s->general_cuts  = true;
+                else if (!strcmp(tok, "geometry")) s->geometry_cuts = true;
+                else if (!strcmp(tok, "dis"))      s->dis_cuts      = true;
+                else                               valid            = false;
+            }
+        }
+        else if (!strcmp(key, "cut")) {
+            expression cut;
+            char * text = strtok(NULL, "\n");
+            valid = text != NULL && !compile_setup_expression(&(setups->back()), text, &cut)
+                    && cut.type == EXPR_BOOL;
+            if (valid) setups->back().cuts.push_back(cut);
+        }
+        else if (!strcmp(key, "define")) {
+            plot_setup * s = &(setups->back());
+            derived_var d;
+            char * name = strtok(NULL, " \t\n");
+            char * text = strtok(NULL, "\n");
+            valid = name != NULL && text != NULL && !compile_setup_expression(s, text, &(d.expr))
+                    && d.expr.type == EXPR_NUM;
 
-    TH1 * plt[pn][plt_size];
-    for (int pi = 0; pi < pn; ++pi) {
-        TString name;
-        int idx = 0;
-        if (px[pi] == 0) {
-            name = Form("%s", S_VAR_LIST[vx[pi][0]]);
-            name_plt(plt[pi], &name, S_VAR_LIST[vx[pi][0]], "", &idx,
-                     dbins, 0, px[pi], bx[pi], rx[pi], bvx, bbx, brx, b_interval);
+            // Names must be new, and be valid in expressions.
+            for (int ci = 0; valid && name[ci] != '\0'; ++ci) {
+                if (!isalnum(name[ci]) && name[ci] != '_') valid = false;
+            }
+            if (valid && (isdigit(name[0]) || find_var(s, name) != -1)) valid = false;
+            if (valid) {
+                d.name = name;
+                s->derived.push_back(d);
+            }
+        }
+        else if (!strcmp(key, "bin")) {
+            bin_dim b;
+            b.var = read_config_var(&(setups->back()));
+            valid = b.var != -1 && read_config_range(b.rx, &(b.nbins));
+            if (valid) setups->back().bins.push_back(b);
+        }
+        else if (!strcmp(key, "plot")) {
+            char * tok  = strtok(NULL, " \t\n");
+            int    type = tok == NULL ? -1 : find_string(PLOT_LIST, PLOT_LIST_SIZE, tok);
+            if (tok != NULL && !strcmp(tok, "std")) {
+                add_std_plots(&(setups->back()));
+            }
+            else {
+                plot_def p;
+                p.type = type;
+                valid  = type != -1;
+                for (int di = 0; di < type+1 && valid; ++di) {
+                    p.vx[di] = read_config_var(&(setups->back()));
+                    valid    = p.vx[di] != -1 && read_config_range(p.rx[di], &(p.bx[di]));
+                }
+                if (valid) setups->back().plots.push_back(p);
+            }
         }
-        if (px[pi] == 1) {
-            name = Form("%s vs %s", S_VAR_LIST[vx[pi][0]], S_VAR_LIST[vx[pi][1]]);
-            name_plt(plt[pi], &name, S_VAR_LIST[vx[pi][0]], S_VAR_LIST[vx[pi][1]], &idx, dbins, 0,
-                     px[pi], bx[pi], rx[pi], bvx, bbx, brx, b_interval);
+        else {
+            valid = false;
+        }
+
+        if (!valid) {
+            fclose(f);
+            return 4;
         }
     }
+    fclose(f);
 
-    // Run through events.
-    for (int i = 0; i < t->GetEntries(); ++i) {
-        t->GetEntry(i);
+    * bad_line = 0;
+    return setups->empty() ? 4 : 0;
+}
 
-        // Apply particle cuts.
-        if (p_charge != INT_MAX) {
-            if (p_charge ==  1 && !(vars[A_CHARGE] >  0)) continue;
-            if (p_charge ==  0 && !(vars[A_CHARGE] == 0)) continue;
-            if (p_charge == -1 && !(vars[A_CHARGE] <  0)) continue;
+// Name the plots of an analysis and find its number of binning cells, their memory, and the
+//     ntuple columns it reads. Analyses without plots get the standard ones. per_row selects how
+//     the default cuts are applied, see fill_block().
+int prepare_plot_setup(plot_setup * s, bool all_cols, bool per_row) {
+    s->per_row = per_row;
+    if (s->plots.empty()) add_std_plots(s);
+    for (plot_def &p : s->plots) {
+        if (p.type == 0) p.name = Form("%s", var_name(s, p.vx[0]));
+        if (p.type == 1) p.name = Form("%s vs %s", var_name(s, p.vx[0]), var_name(s, p.vx[1]));
+
+        // Look up the DIS variables here instead of for each row.
+        for (int di = 0; di < p.type+1; ++di) {
+            p.dis_var[di] = false;
+            if (p.vx[di] >= VAR_LIST_SIZE) continue;
+            for (int li = 0; li < DIS_LIST_SIZE; ++li)
+                if (!strcmp(R_VAR_LIST[p.vx[di]], DIS_LIST[li])) p.dis_var[di] = true;
         }
-        if (p_pid != INT_MAX && vars[A_PID] != p_pid) continue;
+    }
 
-        // Apply other cuts.
-        if (general_cuts) {
-            if (-0.5 < vars[A_PID] && vars[A_PID] <  0.5) continue; // Non-identified particle.
-            if (44.5 < vars[A_PID] && vars[A_PID] < 45.5) continue; // Non-identified particle.
-            if (vars[A_CHI2]/vars[A_NDF] >= CHI2NDFCUT)   continue; // Ignore tracks with high chi2.
+    // Plots are separated by n-dimensional binning. The plots of a binning cell are only booked
+    //     once a row falls in it, so that empty cells take no memory and aren't written.
+    s->plt_size = 1;
+    for (bin_dim &b : s->bins) {
+        b.interval   = (b.rx[1] - b.rx[0])/b.nbins;
+        s->plt_size *= b.nbins;
+    }
+
+    s->cell_mem = 0;
+    for (const plot_def &p : s->plots) s->cell_mem += plt_bytes(&p);
+    printf("%s: binning has %ld cells with %ld plots each (%.1f MB per cell).\n",
+           s->out_filename.Data(), s->plt_size, (long) s->plots.size(), s->cell_mem/1e6);
+
+    find_columns(s, all_cols);
+    return 0;
+}
+
+// Find the entries and chunks of each file of a chain. The number of columns in use_col found in
+//     the ntuples is stored in ncols, and the compressed size of those columns and of the whole
+//     ntuples in zip. Returns 1 if a file can't be read, with its index in bad_file.
+int open_chain(ntuple_chain * ch, const bool use_col[VAR_LIST_SIZE], int * ncols, Long64_t zip[2],
+               int * bad_file) {
+    ch->nentries   .assign(ch->nfiles, 0);
+    ch->first_chunk.assign(ch->nfiles + 1, 0);
+    zip[0] = 0;
+    zip[1] = 0;
+    for (int fi = 0; fi < ch->nfiles; ++fi) {
+        TFile * f_in = TFile::Open(ch->files[fi], "READ");
+        TTree * t    = NULL;
+        if (f_in && !f_in->IsZombie()) t = f_in->Get<TTree>(ch->trk == A_DC ? S_DC : S_FMT);
+        if (t == NULL) {
+            if (f_in) f_in->Close();
+            * bad_file = fi;
+            return 1;
         }
+        ch->nentries[fi]        = t->GetEntries();
+        ch->first_chunk[fi + 1] = ch->first_chunk[fi] + (ch->nentries[fi] + DRAW_CHUNK - 1)
+                                                        / DRAW_CHUNK;
 
-        if (geometry_cuts) {
-            if (calc_magnitude(vars[A_VX], vars[A_VY]) > VXVYCUT) continue;
-            if (VZLOWCUT > vars[A_VZ] || vars[A_VZ] > VZHIGHCUT) continue;
+        * ncols = 0;
+        for (int vi = 0; vi < VAR_LIST_SIZE; ++vi) {
+            TBranch * b = t->GetBranch(S_VAR_LIST[vi]);
+            if (!use_col[vi] || b == NULL) continue;
+            (* ncols)++;
+            zip[0] += b->GetZipBytes();
         }
+        zip[1] += t->GetZipBytes();
+        f_in->Close();
+    }
+    return 0;
+}
 
-        if (dis_cuts && !valid_event[(int) (vars[A_EVENTNO]+0.5)]) continue;
+// Run task over every chunk of the chain ch with nthreads workers, each reading the columns in
+//     use_col from its own copy of the ntuples. task(r, first, last, res) reads entries first to
+//     last of r into a result res of type R, and merge(res, chk) takes the result of each chunk
+//     along with the status of its task, merging it only if the status is 0 and freeing it either
+//     way. Chunks are merged in the chain's order, so that the output doesn't depend on the number
+//     of threads. Once a chunk fails, no more chunks are taken and those already taken are only
+//     freed. The bytes read are stored in bytes. Returns the error of the first chunk that failed
+//     in the chain's order, with the index of its file in bad_file if the file couldn't be read.
+template <typename R, typename TASK, typename MERGE>
+int run_chunks(const ntuple_chain * ch, const bool use_col[VAR_LIST_SIZE], int nthreads,
+               TASK task, MERGE merge, Long64_t * bytes, int * bad_file) {
+    long nchunks = ch->first_chunk[ch->nfiles];
+    std::atomic<long>       next_chunk(0);
+    std::mutex              merge_mutex;
+    std::condition_variable merge_cv;
+    long                    nmerged = 0;
+    std::atomic<bool>       failed(false);
+    int                     status  = 0; // Error of the first chunk that failed.
+    std::vector<Long64_t>   bytes_read(nthreads, 0);
 
-        // Prepare binning vars.
-        Float_t b_vars[dbins];
-        for (long bdi = 0; bdi < dbins; ++bdi) b_vars[bdi] = vars[bvx[bdi]];
+    auto work = [&](int wi) {
+        ntuple_reader r;
+        r.f          = NULL;
+        int r_file   = -1; // File opened by r.
+        int open_chk = 0;
+        while (!failed) {
+            long ci = next_chunk++;
+            if (ci >= nchunks) break;
 
-        for (int pi = 0; pi < pn; ++pi) {
-            // SIDIS variables only make sense for some particles.
-            bool sidis_pass = true;
-            for (int di = 0; di < px[pi]+1; ++di) {
-                for (int li = 0; li < DIS_LIST_SIZE; ++li) {
-                    if (!strcmp(R_VAR_LIST[vx[pi][di]], DIS_LIST[li]) && vars[vx[pi][di]] < 1e-9)
-                        sidis_pass = false;
+            // Switch to the chunk's file if needed.
+            int fi = 0;
+            while (ch->first_chunk[fi + 1] <= ci) ++fi;
+            if (fi != r_file) {
+                if (r.f) {
+                    bytes_read[wi] += r.f->GetBytesRead();
+                    r.f->Close();
                 }
+                open_chk = open_ntuple(&r, ch->files[fi], ch->trk, use_col);
+                r_file   = fi;
             }
-            if (!sidis_pass) continue;
 
-            // Find corresponding bin.
-            int idx = find_idx(dbins, 0, b_vars, bbx, brx, b_interval);
-            if (idx == -1) continue;
+            R        res;
+            Long64_t first = (Long64_t) (ci - ch->first_chunk[fi]) * DRAW_CHUNK;
+            Long64_t last  = std::min(first + DRAW_CHUNK, ch->nentries[fi]);
+            int chk = open_chk;
+            if (chk == 0 && !failed) chk = task(&r, first, last, &res);
 
-            // Fill histogram.
-            if (px[pi] == 0) plt[pi][idx]->Fill(vars[vx[pi][0]]);
-            if (px[pi] == 1) plt[pi][idx]->Fill(vars[vx[pi][0]], vars[vx[pi][1]]);
+            // Wait for the previous chunks to be merged. After an error, results are only freed.
+            std::unique_lock<std::mutex> lock(merge_mutex);
+            merge_cv.wait(lock, [&] {return nmerged == ci;});
+            if (failed) {
+                merge(&res, -1);
+            }
+            else {
+                chk = merge(&res, chk);
+                if (chk) {
+                    failed = true;
+                    status = chk;
+                    if (chk == 1 || chk == 6) * bad_file = fi;
+                }
+            }
+            nmerged++;
+            merge_cv.notify_all();
         }
+        if (r.f) {
+            bytes_read[wi] += r.f->GetBytesRead();
+            r.f->Close();
+        }
+    };
+    if (nthreads == 1) {
+        work(0);
+    }
+    else {
+        std::vector<std::thread> workers;
+        for (int wi = 0; wi < nthreads; ++wi) workers.push_back(std::thread(work, wi));
+        for (int wi = 0; wi < nthreads; ++wi) workers[wi].join();
+    }
+
+    * bytes = 0;
+    for (int wi = 0; wi < nthreads; ++wi) * bytes += bytes_read[wi];
+    return status;
+}
+
+// Find the events of the chain ch and, if dis_cuts is true, which of them have a trigger electron
+//     passing the DIS cuts, storing the latter in selected. Only the event keys and the columns of
+//     the DIS cuts are read. Since the selection covers the whole chain, an event whose rows are
+//     split between chunks or files is counted once, and all of its rows take the selection of its
+//     trigger electron. The entries and events of each run are added to c.
+int select_events(const ntuple_chain * ch, bool dis_cuts, int nthreads, evn_selection * selected,
+                  event_counts * c, Long64_t * bytes, int * bad_file) {
+    bool use_col[VAR_LIST_SIZE];
+    for (int vi = 0; vi < VAR_LIST_SIZE; ++vi) use_col[vi] = false;
+    if (dis_cuts) {
+        use_col[A_PID]    = true;
+        use_col[A_STATUS] = true;
+        use_col[A_Q2]     = true;
+        use_col[A_W2]     = true;
     }
 
-    for (int plti = 0; plti < plt_size; ++plti) {
+    evn_selection seen;
+    long          ngroups = 0;
+    int chk = run_chunks<chunk_events>(ch, use_col, nthreads,
+            [&](ntuple_reader * r, Long64_t first, Long64_t last, chunk_events * ce) {
+                return select_chunk(r, first, last, dis_cuts, ce);
+            },
+            [&](chunk_events * ce, int chk) {
+                if (chk) return chk;
+                evn_selection_merge(&seen,    &(ce->seen));
+                evn_selection_merge(selected, &(ce->selected));
+                ngroups += ce->ngroups;
+                for (const std::pair<const int, long> &run : ce->nentries) {
+                    c->runs[run.first].nentries += run.second;
+                }
+                return 0;
+            }, bytes, bad_file);
+    if (chk) return chk;
+
+    // Count each event once, however many chunks or files its rows are in.
+    for (std::pair<const int, run_counts> &run : c->runs) {
+        run.second.nevents   = evn_selection_count(&seen,    run.first);
+        run.second.nselected = evn_selection_count(selected, run.first);
+        c->nevents   += run.second.nevents;
+        c->nselected += run.second.nselected;
+    }
+    c->nsplit    = ngroups - c->nevents;
+    c->sel_bytes = evn_selection_bytes(&seen) + evn_selection_bytes(selected);
+
+    return 0;
+}
+
+// Fill the plots of the ns analyses s, all from tracker trk, into the grids plt over the nfiles
+//     ntuples in_files, read as a single chain. A first pass finds the events of the chain and
+//     their DIS selection, adding them to counts. A second one fills the plots, reading each entry
+//     once for all analyses. Each ntuple is split in chunks of DRAW_CHUNK entries, which are read
+//     by nthreads workers in parallel regardless of their file. Plots are kept out of ROOT's
+//     directories so that workers don't share any state. Returns 1 if a file can't be read, with
+//     its index in bad_file.
+int fill_plots(char ** in_files, int nfiles, int trk, plot_setup ** s, int ns, plot_grid ** plt,
+               event_counts * counts, int nthreads, int * bad_file) {
+    bool use_col[VAR_LIST_SIZE];
+    for (int vi = 0; vi < VAR_LIST_SIZE; ++vi) {
+        use_col[vi] = false;
+        for (int si = 0; si < ns; ++si) use_col[vi] = use_col[vi] || s[si]->use_col[vi];
+    }
+    bool dis_cuts = false;
+    for (int si = 0; si < ns; ++si) dis_cuts = dis_cuts || s[si]->dis_cuts;
+
+    // Find the chunks of the chain, and compare the compressed size of the columns read with that
+    //     of the whole ntuples.
+    ntuple_chain ch;
+    ch.files  = in_files;
+    ch.nfiles = nfiles;
+    ch.trk    = trk;
+    int      ncols;
+    Long64_t zip[2];
+    if (open_chain(&ch, use_col, &ncols, zip, bad_file)) return 1;
+    Long64_t entries_tot = 0;
+    for (int fi = 0; fi < nfiles; ++fi) entries_tot += ch.nentries[fi];
+    printf("\nReading %d of %d columns of the %s ntuple from %d file(s) for %d analyses (%.1f of "
+           "%.1f MB compressed).\n", ncols, VAR_LIST_SIZE, TRK_LIST[trk], nfiles, ns, zip[0]/1e6,
+           zip[1]/1e6);
+
+    TH1::AddDirectory(kFALSE);
+    if (nthreads > 1) ROOT::EnableThreadSafety();
+
+    // Find the events and their DIS selection.
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    evn_selection selected;
+    Long64_t      bytes_tot;
+    int chk = select_events(&ch, dis_cuts, nthreads, &selected, counts, &bytes_tot, bad_file);
+    if (chk) return chk;
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    double sel_s = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec)*1e-9;
+    printf("Found %ld events from %ld run(s) in %.2f s. Read %.1f MB, selection takes %.1f MB.\n",
+           counts->nevents, (long) counts->runs.size(), sel_s, bytes_tot/1e6,
+           counts->sel_bytes/1e6);
+    if (dis_cuts) printf("%ld events pass the DIS cuts.\n", counts->nselected);
+    if (counts->nsplit > 0) {
+        printf("%ld events had their rows split along the ntuples.\n", counts->nsplit);
+    }
+
+    // Fill.
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    printf("Reading %lld entries in %ld chunk(s) with %d thread(s).\n", entries_tot,
+           ch.first_chunk[nfiles], nthreads);
+    // Plots of the grids being filled count towards the memory budget as well as the merged ones.
+    //     Merging frees the plots of cells plt already has, so their memory is given back.
+    std::atomic<long> mem(0);
+    std::atomic<long> fill_ns(0);
+    chk = run_chunks<std::vector<plot_grid>>(&ch, use_col, nthreads,
+            [&](ntuple_reader * r, Long64_t first, Long64_t last, std::vector<plot_grid> * g) {
+                g->resize(ns);
+                for (int si = 0; si < ns; ++si) {
+                    (* g)[si].mem     = &mem;
+                    (* g)[si].fill_ns = &fill_ns;
+                }
+                return fill_chunk(s, ns, r, first, last, g->data(), &selected);
+            },
+            [&](std::vector<plot_grid> * g, int chk) {
+                for (UInt_t si = 0; si < g->size(); ++si) {
+                    long ncells = plt[si]->cells.size() + (* g)[si].cells.size();
+                    if (chk == 0) merge_plot_grid(plt[si], &((* g)[si]));
+                    free_plot_grid(&((* g)[si]));
+                    mem -= (long) ((ncells - plt[si]->cells.size()) * s[si]->cell_mem);
+                }
+                return chk;
+            }, &bytes_tot, bad_file);
+    if (chk) return chk;
+
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    double fill_s = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec)*1e-9;
+    printf("Filled %lld entries in %.2f s (%.2f M entries/s). Read %.1f MB (%.1f MB/s).\n",
+           entries_tot, fill_s, fill_s > 0 ? entries_tot/fill_s*1e-6 : 0., bytes_tot/1e6,
+           fill_s > 0 ? bytes_tot/fill_s*1e-6 : 0.);
+    // Reading is left out here, so that cutting by column and row by row (-r) can be compared.
+    double cut_s = fill_ns*1e-9;
+    printf("Cut and filled rows %s in %.2f thread-s (%.2f M entries/s per thread).\n",
+           s[0]->per_row ? "row by row" : "by column", cut_s,
+           cut_s > 0 ? entries_tot/cut_s*1e-6 : 0.);
+
+    return 0;
+}
+
+// Write the plots of an analysis to its output file, with one directory per populated binning
+//     cell, along with the entries and events read from each run for normalization. Returns 5 if
+//     the file can't be created.
+int write_plots(plot_setup * s, plot_grid * plt, const event_counts * counts) {
+    printf("%s: populated %ld of %ld binning cells (%.1f MB).\n", s->out_filename.Data(),
+           (long) plt->cells.size(), s->plt_size, plt->cells.size() * s->cell_mem/1e6);
+
+    TFile * f_out = TFile::Open(s->out_filename, "RECREATE");
+    if (!f_out || f_out->IsZombie()) return 5;
+    for (std::pair<const long, std::vector<TH1 *>> &cell : plt->cells) {
         // Find dir.
         TString dir;
-        find_bin(&dir, plt_size, plti, dbins, 0, INT_MAX, bvx, bbx, brx, b_interval);
+        find_bin(s, cell.first, &dir);
         f_out->mkdir(dir);
         f_out->cd(dir);
 
         // Write plot(s).
-        for (int pi = 0; pi < pn; ++pi) plt[pi][plti]->Write();
+        for (TH1 * h : cell.second) h->Write();
     }
 
-    // === CLEAN-UP ================================================================================
-    f_in ->Close();
+    // Write run counts.
+    f_out->cd();
+    Int_t    run_no;
+    Long64_t nentries, nevents, nselected;
+    TTree * t = new TTree(S_RUNCOUNTS, "Entries and events read from each run");
+    t->Branch(R_RUNNO,     &run_no,    R_RUNNO     "/I");
+    t->Branch(R_NENTRIES,  &nentries,  R_NENTRIES  "/L");
+    t->Branch(R_NEVENTS,   &nevents,   R_NEVENTS   "/L");
+    t->Branch(R_NSELECTED, &nselected, R_NSELECTED "/L");
+    for (const std::pair<const int, run_counts> &run : counts->runs) {
+        run_no    = run.first;
+        nentries  = run.second.nentries;
+        nevents   = run.second.nevents;
+        nselected = run.second.nselected;
+        t->Fill();
+    }
+    t->Write();
     f_out->Close();
 
     return 0;
 }
 
+int run(char ** in_files, int nfiles, char * config_file, int nthreads, bool all_cols,
+        bool per_row, int * bad_file, int * bad_line) {
+    // Check input files.
+    for (int fi = 0; fi < nfiles; ++fi) {
+        TFile * f_in = TFile::Open(in_files[fi], "READ");
+        if (!f_in || f_in->IsZombie()) {
+            * bad_file = fi;
+            return 1;
+        }
+        f_in->Close();
+    }
+
+    // NOTE. This function could receive a few arguments to speed IO up. Pre-configured cuts,
+    //       binnings, and corrections would be nice.
+    // TODO. Prepare corrections (acceptance, radiative, Feynman, etc...).
+
+    // Set up analyses, from the config file if given or from the user otherwise.
+    std::vector<plot_setup> setups;
+    if (config_file != NULL) {
+        int chk = read_plot_config(config_file, &setups, bad_line);
+        if (chk) return chk;
+    }
+    else {
+        setups.push_back(plot_setup_init());
+        ask_plot_setup(&(setups[0]));
+    }
+    printf("\n");
+    for (plot_setup &s : setups) prepare_plot_setup(&s, all_cols, per_row);
+
+    // Fill all analyses of each tracker in one pass over its ntuples.
+    std::vector<plot_grid>    plt(setups.size());
+    std::vector<event_counts> counts(TRK_LIST_SIZE, event_counts_init());
+    for (int trk = 0; trk < TRK_LIST_SIZE; ++trk) {
+        std::vector<plot_setup *> trk_s;
+        std::vector<plot_grid *>  trk_plt;
+        for (UInt_t si = 0; si < setups.size(); ++si) {
+            if (setups[si].trk != trk) continue;
+            trk_s  .push_back(&(setups[si]));
+            trk_plt.push_back(&(plt[si]));
+        }
+        if (trk_s.empty()) continue;
+
+        int chk = fill_plots(in_files, nfiles, trk, trk_s.data(), trk_s.size(), trk_plt.data(),
+                             &(counts[trk]), nthreads, bad_file);
+        if (chk) {
+            for (plot_grid &g : plt) free_plot_grid(&g);
+            return chk;
+        }
+    }
+
+    // Write and clean up.
+    printf("\n");
+    int chk = 0;
+    for (UInt_t si = 0; si < setups.size(); ++si) {
+        if (chk == 0) chk = write_plots(&(setups[si]), &(plt[si]), &(counts[setups[si].trk]));
+        free_plot_grid(&(plt[si]));
+    }
+
+    return chk;
+}
+
 // Call program from terminal, C-style.
 int main(int argc, char ** argv) {
-    return run();
+    int     nthreads    = 1;
+    bool    all_cols    = false;
+    bool    per_row     = false;
+    char *  config_file = NULL;
+    char ** in_files    = NULL;
+    int     nfiles      = 0;
+
+    if (draw_plots_handle_args_err(draw_plots_handle_args(argc, argv, &nthreads, &all_cols,
+            &per_row, &config_file, &in_files, &nfiles), in_files, nfiles, &config_file))
+        return 1;
+
+    int bad_file = -1;
+    int bad_line = 0;
+    int errcode  = run(in_files, nfiles, config_file, nthreads, all_cols, per_row, &bad_file,
+                           &bad_line);
+    return draw_plots_err(errcode, in_files, nfiles, bad_file, &config_file, bad_line);
 }
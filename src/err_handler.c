@@ -11,11 +11,15 @@
 //
 // You can see a copy of the GNU Lesser Public License under the LICENSE file.
 
+#include "../lib/constants.h"
 #include "../lib/err_handler.h"
 
 int make_ntuples_usage() {
-    fprintf(stderr, "Usage: make_ntuples [-fd] [-n NEVENTS] file\n");
+    fprintf(stderr, "Usage: make_ntuples [-dx] [-n NEVENTS] file\n");
     fprintf(stderr, " * -d: Activate debug mode. Only use when programming new features.\n");
+    fprintf(stderr, " * -x: Extract the sampling fraction in the same read instead of taking it\n");
+    fprintf(stderr, "       from ../data/sf_params_XXXXXX.txt. Tracks are kept in memory until\n");
+    fprintf(stderr, "       it's fitted.\n");
     fprintf(stderr, " * -n NEVENTS: Specify number of events to be processed with optarg.\n");
     fprintf(stderr, " * file: ROOT file to be processed. Expected file format is: `run_no.root`.\n");
     return 1;
@@ -74,6 +78,24 @@ int make_ntuples_err(int errcode, char ** in_filename) {
         case 3:
             fprintf(stderr, "Error. Invalid Cherenkov Counter ID. Check bank integrity.\n");
             break;
+        case 8:
+            fprintf(stderr, "Error. No sampling fraction available for input file! Run ");
+            fprintf(stderr, "extract_sf before generating the ntuples, or use -x.\n");
+            break;
+        case 9:
+            fprintf(stderr, "Error. A particle is in an invalid sector. Check bank integrity.\n");
+            break;
+        case 10:
+            fprintf(stderr, "Error. Could not create sf_results file.\n");
+            break;
+        case 11:
+            fprintf(stderr, "Error. Could not create state file.\n");
+            break;
+        case 12:
+            fprintf(stderr, "Error. A run or event number of %s doesn't fit in a (run, event) ",
+                    * in_filename);
+            fprintf(stderr, "key of %d event bits.\n", EVNKEY_BITS);
+            break;
         default:
             fprintf(stderr, "Programmer Error. Error code %d not implemented in \n", errcode);
             fprintf(stderr, "make_ntuples_err()! You're on your own.\n");
@@ -84,19 +106,49 @@ int make_ntuples_err(int errcode, char ** in_filename) {
 }
 
 int extractsf_usage() {
-    fprintf(stderr, "Usage: extract_sf [-f] [-n NEVENTS] file\n");
+    fprintf(stderr, "Usage: extract_sf [-fac] [-n NEVENTS] [-j NTHREADS] [-o STATEFILE] ");
+    fprintf(stderr, "[-p PERIOD] [-e PRECISION] [-k NCHECK] [-s SEEDFILE] file [...]\n");
     fprintf(stderr, " * -f: Use FMT data. If unspecified, program will only use DC data.\n");
-    fprintf(stderr, " * -n NEVENTS: Specify number of events to be processed with optarg.\n");
-    fprintf(stderr, " * file: ROOT file to be processed.\n");
+    fprintf(stderr, " * -n NEVENTS: Specify number of events to be processed per file.\n");
+    fprintf(stderr, " * -j NTHREADS: Threads used to fill and fit histograms. Default is 1.\n");
+    fprintf(stderr, " * -a: Use fast fits (truncated moments and linear least squares)\n");
+    fprintf(stderr, "       instead of Minuit. Minuit is still used where they fail.\n");
+    fprintf(stderr, " * -c: Run both fast and Minuit fits, and compare their results.\n");
+    fprintf(stderr, " * -o STATEFILE: File where filled histograms are saved, to be merged later\n");
+    fprintf(stderr, "       by merge_sf. Default is ../root_io/sf_state_XXXXXX.root per run.\n");
+    fprintf(stderr, "       Only valid if all files are from the same run, and without -p.\n");
+    fprintf(stderr, " * -p PERIOD: Also fit all runs combined, saving the results with\n");
+    fprintf(stderr, "       PERIOD in place of the run number. PERIOD can't be the run number\n");
+    fprintf(stderr, "       of an input file.\n");
+    fprintf(stderr, " * -e PRECISION: Stop reading a run once the uncertainties of all its fast\n");
+    fprintf(stderr, "       fit parameters are below PRECISION, checked every NCHECK events.\n");
+    fprintf(stderr, " * -k NCHECK: Events read from each run between precision checks. Default\n");
+    fprintf(stderr, "       is %d.\n", SF_CHECK_NEVN);
+    fprintf(stderr, " * -s SEEDFILE: Start Minuit fits from the results of a reference run,\n");
+    fprintf(stderr, "       read from its sf_params .txt file or from its state file.\n");
+    fprintf(stderr, " * file: ROOT files to be processed. Files from the same run are added\n");
+    fprintf(stderr, "       together, and each run is fitted separately.\n");
     return 1;
 }
 
-int extractsf_err(int errcode, char ** in_filename) {
+// Free list of input files, run numbers, state file, and seed file from extract_sf.
+int extractsf_free(char **in_files, int *run_nos, int nfiles, char **state_file,
+                   char **seed_file) {
+    for (int fi = 0; fi < nfiles; ++fi) free(in_files[fi]);
+    free(in_files);
+    free(run_nos);
+    free(* state_file);
+    free(* seed_file);
+    return 0;
+}
+
+int extractsf_err(int errcode, char **in_files, int *run_nos, int nfiles, int bad_file,
+                  char **state_file, char **seed_file) {
     switch (errcode) {
         case 0:
             return 0;
         case 1:
-            fprintf(stderr, "Error. %s is not a valid ROOT file.\n", * in_filename);
+            fprintf(stderr, "Error. %s is not a valid ROOT file.\n", in_files[bad_file]);
             break;
         case 2:
             fprintf(stderr, "Error. Invalid EC layer. Check bank data or add layer to constants.\n");
@@ -107,34 +159,76 @@ int extractsf_err(int errcode, char ** in_filename) {
         case 4:
             fprintf(stderr, "Error. Could not create sf_results file.\n");
             break;
+        case 5:
+            fprintf(stderr, "Error. Could not create state file.\n");
+            break;
+        case 6:
+            fprintf(stderr, "Error. Could not read fit seeds from %s.\n", * seed_file);
+            break;
         default:
             fprintf(stderr, "Programmer Error. Error code %d not implemented in \n", errcode);
-            fprintf(stderr, "make_ntuples_err()! You're on your own.\n");
+            fprintf(stderr, "extractsf_err()! You're on your own.\n");
             break;
     }
-    free(* in_filename);
+    extractsf_free(in_files, run_nos, nfiles, state_file, seed_file);
     return 1;
 }
 
-int extractsf_handle_args_err(int errcode, char ** in_filename) {
+int extractsf_handle_args_err(int errcode, char **in_files, int *run_nos, int nfiles,
+                              char **state_file, char **seed_file) {
     switch (errcode) {
         case 0:
             return 0;
         case 1:
+            extractsf_free(in_files, run_nos, nfiles, state_file, seed_file);
             return extractsf_usage();
         case 2:
             fprintf(stderr, "Error. nevents should be a number greater than 0.\n");
+            extractsf_free(in_files, run_nos, nfiles, state_file, seed_file);
             return extractsf_usage();
         case 3:
-            fprintf(stderr, "Error. input file (%s) should be a root file.\n", * in_filename);
-            free(* in_filename);
+            fprintf(stderr, "Error. input file (%s) should be a root file.\n", in_files[nfiles-1]);
+            extractsf_free(in_files, run_nos, nfiles, state_file, seed_file);
             return 1;
         case 4:
-            fprintf(stderr, "Error. %s does not exist!\n", * in_filename);
-            free(* in_filename);
+            fprintf(stderr, "Error. %s does not exist!\n", in_files[nfiles-1]);
+            extractsf_free(in_files, run_nos, nfiles, state_file, seed_file);
             return 1;
         case 5:
             fprintf(stderr, "Error. No file name provided.\n");
+            extractsf_free(in_files, run_nos, nfiles, state_file, seed_file);
+            return extractsf_usage();
+        case 6:
+            fprintf(stderr, "Error. nthreads should be a number greater than 0.\n");
+            extractsf_free(in_files, run_nos, nfiles, state_file, seed_file);
+            return extractsf_usage();
+        case 7:
+            fprintf(stderr, "Error. Couldn't find a known run number in %s.\n", in_files[nfiles-1]);
+            extractsf_free(in_files, run_nos, nfiles, state_file, seed_file);
+            return 1;
+        case 8:
+            fprintf(stderr, "Error. -o can't be used with files from different runs.\n");
+            extractsf_free(in_files, run_nos, nfiles, state_file, seed_file);
+            return extractsf_usage();
+        case 9:
+            fprintf(stderr, "Error. PERIOD should be a number greater than 0.\n");
+            extractsf_free(in_files, run_nos, nfiles, state_file, seed_file);
+            return extractsf_usage();
+        case 10:
+            fprintf(stderr, "Error. PRECISION should be a number greater than 0.\n");
+            extractsf_free(in_files, run_nos, nfiles, state_file, seed_file);
+            return extractsf_usage();
+        case 11:
+            fprintf(stderr, "Error. NCHECK should be a number greater than 0.\n");
+            extractsf_free(in_files, run_nos, nfiles, state_file, seed_file);
+            return extractsf_usage();
+        case 12:
+            fprintf(stderr, "Error. -o can't be used with -p.\n");
+            extractsf_free(in_files, run_nos, nfiles, state_file, seed_file);
+            return extractsf_usage();
+        case 13:
+            fprintf(stderr, "Error. PERIOD can't be the run number of an input file.\n");
+            extractsf_free(in_files, run_nos, nfiles, state_file, seed_file);
             return extractsf_usage();
         default:
             fprintf(stderr, "Programmer Error. Error code %d not implemented in ", errcode);
@@ -143,6 +237,99 @@ int extractsf_handle_args_err(int errcode, char ** in_filename) {
     }
 }
 
+int merge_sf_usage() {
+    fprintf(stderr, "Usage: merge_sf [-j NTHREADS] [-a] [-c] [-o STATEFILE] [-s SEEDFILE] ");
+    fprintf(stderr, "statefile [...]\n");
+    fprintf(stderr, " * -j NTHREADS: Threads used to fit histograms. Default is 1.\n");
+    fprintf(stderr, " * -a: Use fast fits (truncated moments and linear least squares)\n");
+    fprintf(stderr, "       instead of Minuit. Minuit is still used where they fail.\n");
+    fprintf(stderr, " * -c: Run both fast and Minuit fits, and compare their results.\n");
+    fprintf(stderr, " * -o STATEFILE: Save merged histograms to STATEFILE, so that more files\n");
+    fprintf(stderr, "       can be added to them later.\n");
+    fprintf(stderr, " * -s SEEDFILE: Start Minuit fits from the results of a reference run,\n");
+    fprintf(stderr, "       read from its sf_params .txt file or from its state file.\n");
+    fprintf(stderr, " * statefile: State files written by extract_sf or merge_sf, all from the\n");
+    fprintf(stderr, "       same run.\n");
+    return 1;
+}
+
+// Free list of input files, output file, and seed file from merge_sf.
+int merge_sf_free(char **in_files, int nfiles, char **out_file, char **seed_file) {
+    for (int fi = 0; fi < nfiles; ++fi) free(in_files[fi]);
+    free(in_files);
+    free(* out_file);
+    free(* seed_file);
+    return 0;
+}
+
+int merge_sf_handle_args_err(int errcode, char **in_files, int nfiles, char **out_file,
+                             char **seed_file) {
+    switch (errcode) {
+        case 0:
+            return 0;
+        case 1:
+            merge_sf_free(in_files, nfiles, out_file, seed_file);
+            return merge_sf_usage();
+        case 2:
+            fprintf(stderr, "Error. nthreads should be a number greater than 0.\n");
+            merge_sf_free(in_files, nfiles, out_file, seed_file);
+            return merge_sf_usage();
+        case 3:
+            fprintf(stderr, "Error. input file (%s) should be a root file.\n", in_files[nfiles-1]);
+            merge_sf_free(in_files, nfiles, out_file, seed_file);
+            return 1;
+        case 4:
+            fprintf(stderr, "Error. %s does not exist!\n", in_files[nfiles-1]);
+            merge_sf_free(in_files, nfiles, out_file, seed_file);
+            return 1;
+        case 5:
+            fprintf(stderr, "Error. No state file provided.\n");
+            merge_sf_free(in_files, nfiles, out_file, seed_file);
+            return merge_sf_usage();
+        default:
+            fprintf(stderr, "Programmer Error. Error code %d not implemented in ", errcode);
+            fprintf(stderr, "merge_sf_handle_args()! You're on your own.\n");
+            return 1;
+    }
+}
+
+int merge_sf_err(int errcode, char **in_files, int nfiles, int bad_file, char **out_file,
+                 char **seed_file) {
+    switch (errcode) {
+        case 0:
+            return 0;
+        case 1:
+            fprintf(stderr, "Error. Could not open %s.\n", in_files[bad_file]);
+            break;
+        case 2:
+            fprintf(stderr, "Error. %s is not a valid state file.\n", in_files[bad_file]);
+            break;
+        case 3:
+            fprintf(stderr, "Error. %s is from a different run than previous files.\n",
+                    in_files[bad_file]);
+            break;
+        case 4:
+            fprintf(stderr, "Error. Could not create sf_results file.\n");
+            break;
+        case 5:
+            fprintf(stderr, "Error. Could not create state file.\n");
+            break;
+        case 6:
+            fprintf(stderr, "Error. %s doesn't match previous files in FMT usage.\n",
+                    in_files[bad_file]);
+            break;
+        case 7:
+            fprintf(stderr, "Error. Could not read fit seeds from %s.\n", * seed_file);
+            break;
+        default:
+            fprintf(stderr, "Programmer Error. Error code %d not implemented in ", errcode);
+            fprintf(stderr, "merge_sf_err()! You're on your own.\n");
+            break;
+    }
+    merge_sf_free(in_files, nfiles, out_file, seed_file);
+    return 1;
+}
+
 int hipo2root_usage() {
     fprintf(stderr, "Usage: hipo2root filename\n");
     return 1;
@@ -172,3 +359,187 @@ int hipo2root_handle_args_err(int errcode, char ** in_filename) {
             return 1;
     }
 }
+
+int audit_kinematics_usage() {
+    fprintf(stderr, "Usage: audit_kinematics [-n NEVENTS]\n");
+    fprintf(stderr, " * -n NEVENTS: Number of synthetic events to be generated.\n");
+    return 1;
+}
+
+int audit_kinematics_handle_args_err(int errcode) {
+    switch (errcode) {
+        case 0:
+            return 0;
+        case 1:
+            return audit_kinematics_usage();
+        case 2:
+            fprintf(stderr, "Error. nevents should be a number greater than 0.\n");
+            return audit_kinematics_usage();
+        default:
+            fprintf(stderr, "Programmer Error. Error code %d not implemented in ", errcode);
+            fprintf(stderr, "audit_kinematics_handle_args()! You're on your own.\n");
+            return 1;
+    }
+}
+
+int audit_kinematics_err(int errcode) {
+    switch (errcode) {
+        case 0:
+            return 0;
+        case 1:
+            fprintf(stderr, "Error. Not enough memory for the synthetic sample. Use fewer ");
+            fprintf(stderr, "events.\n");
+            break;
+        case 2:
+            fprintf(stderr, "Error. Batch kinematics differ from the scalar ones by more than ");
+            fprintf(stderr, "float precision.\n");
+            break;
+        case 3:
+            fprintf(stderr, "Error. pid_mass() differs from the masses it replaced. Check ");
+            fprintf(stderr, "PID_TABLE.\n");
+            break;
+        default:
+            fprintf(stderr, "Programmer Error. Error code %d not implemented in ", errcode);
+            fprintf(stderr, "audit_kinematics()! You're on your own.\n");
+            break;
+    }
+    return 1;
+}
+
+int audit_selection_usage() {
+    fprintf(stderr, "Usage: audit_selection [-r NRUNS] [-n NEVENTS]\n");
+    fprintf(stderr, " * -r NRUNS: Number of synthetic runs. Default is 3.\n");
+    fprintf(stderr, " * -n NEVENTS: Number of events per run. Default is 120000000.\n");
+    return 1;
+}
+
+int audit_selection_handle_args_err(int errcode) {
+    switch (errcode) {
+        case 0:
+            return 0;
+        case 1:
+            return audit_selection_usage();
+        case 2:
+            fprintf(stderr, "Error. nruns should be a number greater than 0.\n");
+            return audit_selection_usage();
+        case 3:
+            fprintf(stderr, "Error. nevents should be a number between 1 and 2^%d.\n",
+                    EVNKEY_BITS-1);
+            return audit_selection_usage();
+        default:
+            fprintf(stderr, "Programmer Error. Error code %d not implemented in ", errcode);
+            fprintf(stderr, "audit_selection_handle_args()! You're on your own.\n");
+            return 1;
+    }
+}
+
+int audit_selection_err(int errcode) {
+    switch (errcode) {
+        case 0:
+            return 0;
+        case 1:
+            fprintf(stderr, "Error. A synthetic event couldn't be keyed. Use fewer runs.\n");
+            break;
+        case 2:
+            fprintf(stderr, "Error. Events were read back from the selection wrong.\n");
+            break;
+        case 3:
+            fprintf(stderr, "Error. The selection takes over twice the memory its bits need.\n");
+            break;
+        default:
+            fprintf(stderr, "Programmer Error. Error code %d not implemented in ", errcode);
+            fprintf(stderr, "audit_selection()! You're on your own.\n");
+            break;
+    }
+    return 1;
+}
+
+int draw_plots_usage() {
+    fprintf(stderr, "Usage: draw_plots [-a] [-r] [-j NTHREADS] [-c CONFIG] [infile ...]\n");
+    fprintf(stderr, " * -a: Read all ntuple columns instead of only those needed by the cuts,\n");
+    fprintf(stderr, "       binning, and plots. Useful to measure the speedup of not doing so.\n");
+    fprintf(stderr, " * -r: Apply the default cuts row by row instead of over blocks of rows by\n");
+    fprintf(stderr, "       column. Useful to measure the speedup of not doing so.\n");
+    fprintf(stderr, " * -j NTHREADS: Threads used to fill plots. Output doesn't depend on it.\n");
+    fprintf(stderr, "       Default is 1.\n");
+    fprintf(stderr, " * -c CONFIG: Read the analyses to draw from CONFIG instead of asking for\n");
+    fprintf(stderr, "       them, filling all of them in one pass over the ntuples. See README.\n");
+    fprintf(stderr, " * infile: Ntuples files from make_ntuples, read as a single chain. The\n");
+    fprintf(stderr, "       entries and events read from each run are written to the output.\n");
+    fprintf(stderr, "       Default is %s.\n", DRAW_INFILE);
+    return 1;
+}
+
+int draw_plots_free(char **in_files, int nfiles, char **config_file) {
+    for (int fi = 0; fi < nfiles; ++fi) free(in_files[fi]);
+    free(in_files);
+    free(* config_file);
+    return 0;
+}
+
+int draw_plots_handle_args_err(int errcode, char **in_files, int nfiles, char **config_file) {
+    switch (errcode) {
+        case 0:
+            return 0;
+        case 1:
+            draw_plots_free(in_files, nfiles, config_file);
+            return draw_plots_usage();
+        case 2:
+            fprintf(stderr, "Error. nthreads should be a number greater than 0.\n");
+            draw_plots_free(in_files, nfiles, config_file);
+            return draw_plots_usage();
+        case 3:
+            fprintf(stderr, "Error. input file (%s) should be a root file.\n", in_files[nfiles-1]);
+            draw_plots_free(in_files, nfiles, config_file);
+            return 1;
+        case 4:
+            fprintf(stderr, "Error. %s does not exist!\n", in_files[nfiles-1]);
+            draw_plots_free(in_files, nfiles, config_file);
+            return 1;
+        default:
+            fprintf(stderr, "Programmer Error. Error code %d not implemented in ", errcode);
+            fprintf(stderr, "draw_plots_handle_args()! You're on your own.\n");
+            draw_plots_free(in_files, nfiles, config_file);
+            return 1;
+    }
+}
+
+int draw_plots_err(int errcode, char **in_files, int nfiles, int bad_file, char **config_file,
+                   int bad_line) {
+    switch (errcode) {
+        case 0:
+            break;
+        case 1:
+            fprintf(stderr, "Error. Could not open %s.\n", in_files[bad_file]);
+            break;
+        case 2:
+            fprintf(stderr, "Error. Plots exceed the %d MB memory budget. Use fewer bins.\n",
+                    PLT_MAXMB);
+            break;
+        case 3:
+            fprintf(stderr, "Error. Could not open %s.\n", * config_file);
+            break;
+        case 4:
+            if (bad_line > 0) fprintf(stderr, "Error. Invalid line %d in %s.\n", bad_line,
+                                      * config_file);
+            else              fprintf(stderr, "Error. No analysis found in %s.\n", * config_file);
+            break;
+        case 5:
+            fprintf(stderr, "Error. Could not create an output file.\n");
+            break;
+        case 6:
+            fprintf(stderr, "Error. %s has a row with an invalid run or event number.\n",
+                    in_files[bad_file]);
+            break;
+        case 7:
+            fprintf(stderr, "Error. Line %d in %s is longer than %d characters.\n", bad_line,
+                    * config_file, DRAW_LINELEN);
+            break;
+        default:
+            fprintf(stderr, "Programmer Error. Error code %d not implemented in ", errcode);
+            fprintf(stderr, "draw_plots()! You're on your own.\n");
+            break;
+    }
+    draw_plots_free(in_files, nfiles, config_file);
+    return errcode == 0 ? 0 : 1;
+}
@@ -0,0 +1,315 @@
+// CLAS12 RG-E Analyser.
+// Copyright (C) 2022 Bruno Benkel
+//
+// This program is free software: you can redistribute it and/or modify it under the terms of the
+// GNU Lesser General Public License as published by the Free Software Foundation, either version 3
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+// even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// Lesser General Public License for more details.
+//
+// You can see a copy of the GNU Lesser Public License under the LICENSE file.
+
+#include <ctype.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../lib/expression.h"
+
+// Functions available in expressions.
+typedef struct {
+    const char * name;
+    expr_op      op;
+    int          nargs;
+} expr_func;
+
+#define EXPR_NFUNCS 11
+const expr_func EXPR_FUNCS[EXPR_NFUNCS] = {
+        {"abs", EXPR_ABS, 1}, {"sqrt", EXPR_SQRT, 1}, {"exp", EXPR_EXP, 1}, {"log", EXPR_LOG, 1},
+        {"sin", EXPR_SIN, 1}, {"cos", EXPR_COS, 1}, {"tan", EXPR_TAN, 1},
+        {"atan2", EXPR_ATAN2, 2}, {"pow", EXPR_POW, 2}, {"min", EXPR_MIN, 2}, {"max", EXPR_MAX, 2}
+};
+
+// Recursive descent parser, writing postfix code to e as it goes. Each parse_* function returns
+//     the type of what it parsed, or -1 if it's invalid.
+typedef struct {
+    const char *  pos;
+    const char ** names;
+    int           nnames;
+    expression  * e;
+    int           depth; // Values on the stack after the code emitted so far.
+} expr_parser;
+
+int parse_or(expr_parser * p);
+
+// Append an instruction, keeping track of the stack depth. pops is the number of values it takes
+//     from the stack, and each instruction pushes a single value back.
+int emit(expr_parser * p, expr_op op, int pops, int col, float value) {
+    expr_instr ins;
+    ins.op    = op;
+    ins.col   = col;
+    ins.value = value;
+    p->e->code.push_back(ins);
+
+    p->depth += 1 - pops;
+    if (p->depth > p->e->depth) p->e->depth = p->depth;
+    return 0;
+}
+
+// Skip whitespace and consume token if it comes next.
+bool match(expr_parser * p, const char * token) {
+    while (isspace(* p->pos)) p->pos++;
+    if (strncmp(p->pos, token, strlen(token))) return false;
+    p->pos += strlen(token);
+    return true;
+}
+
+// Parse a number, a column, a function call, or an expression between parentheses.
+int parse_atom(expr_parser * p) {
+    while (isspace(* p->pos)) p->pos++;
+
+    if (match(p, "(")) {
+        int type = parse_or(p);
+        if (type == -1 || !match(p, ")")) return -1;
+        return type;
+    }
+
+    if (isdigit(* p->pos) || * p->pos == '.') {
+        char * end;
+        double value = strtod(p->pos, &end);
+        if (end == p->pos) return -1;
+        p->pos = end;
+        emit(p, EXPR_CONST, 0, 0, value);
+        return EXPR_NUM;
+    }
+
+    // Read identifier.
+    char name[64];
+    int  len = 0;
+    while ((isalnum(* p->pos) || * p->pos == '_') && len < 63) name[len++] = * (p->pos++);
+    name[len] = '\0';
+    if (len == 0) return -1;
+
+    if (match(p, "(")) {
+        int fi = 0;
+        while (fi < EXPR_NFUNCS && strcmp(name, EXPR_FUNCS[fi].name)) ++fi;
+        if (fi == EXPR_NFUNCS) return -1;
+
+        for (int ai = 0; ai < EXPR_FUNCS[fi].nargs; ++ai) {
+            if (ai > 0 && !match(p, ",")) return -1;
+            if (parse_or(p) != EXPR_NUM) return -1;
+        }
+        if (!match(p, ")")) return -1;
+        emit(p, EXPR_FUNCS[fi].op, EXPR_FUNCS[fi].nargs, 0, 0);
+        return EXPR_NUM;
+    }
+
+    for (int ci = 0; ci < p->nnames; ++ci) {
+        if (strcmp(name, p->names[ci])) continue;
+        emit(p, EXPR_COL, 0, ci, 0);
+        return EXPR_NUM;
+    }
+    return -1;
+}
+
+// Parse a negation or an atom.
+int parse_unary(expr_parser * p) {
+    if (match(p, "-")) {
+        if (parse_unary(p) != EXPR_NUM) return -1;
+        emit(p, EXPR_NEG, 1, 0, 0);
+        return EXPR_NUM;
+    }
+    return parse_atom(p);
+}
+
+// Parse a product or division.
+int parse_prod(expr_parser * p) {
+    int type = parse_unary(p);
+    while (true) {
+        expr_op op;
+        if      (match(p, "*")) op = EXPR_MUL;
+        else if (match(p, "/")) op = EXPR_DIV;
+        else                    return type;
+
+        if (type != EXPR_NUM || parse_unary(p) != EXPR_NUM) return -1;
+        emit(p, op, 2, 0, 0);
+    }
+}
+
+// Parse a sum or subtraction.
+int parse_sum(expr_parser * p) {
+    int type = parse_prod(p);
+    while (true) {
+        expr_op op;
+        if      (match(p, "+")) op = EXPR_ADD;
+        else if (match(p, "-")) op = EXPR_SUB;
+        else                    return type;
+
+        if (type != EXPR_NUM || parse_prod(p) != EXPR_NUM) return -1;
+        emit(p, op, 2, 0, 0);
+    }
+}
+
+// Parse a comparison between two numbers. Comparisons can't be chained.
+int parse_cmp(expr_parser * p) {
+    int type = parse_sum(p);
+
+    expr_op op;
+    if      (match(p, "<=")) op = EXPR_LE;
+    else if (match(p, ">=")) op = EXPR_GE;
+    else if (match(p, "==")) op = EXPR_EQ;
+    else if (match(p, "!=")) op = EXPR_NE;
+    else if (match(p, "<"))  op = EXPR_LT;
+    else if (match(p, ">"))  op = EXPR_GT;
+    else                     return type;
+
+    if (type != EXPR_NUM || parse_sum(p) != EXPR_NUM) return -1;
+    emit(p, op, 2, 0, 0);
+    return EXPR_BOOL;
+}
+
+// Parse a logical not or a comparison.
+int parse_not(expr_parser * p) {
+    if (match(p, "!")) {
+        if (parse_not(p) != EXPR_BOOL) return -1;
+        emit(p, EXPR_NOT, 1, 0, 0);
+        return EXPR_BOOL;
+    }
+    return parse_cmp(p);
+}
+
+// Parse a logical and.
+int parse_and(expr_parser * p) {
+    int type = parse_not(p);
+    while (match(p, "&&")) {
+        if (type != EXPR_BOOL || parse_not(p) != EXPR_BOOL) return -1;
+        emit(p, EXPR_AND, 2, 0, 0);
+    }
+    return type;
+}
+
+// Parse a logical or.
+int parse_or(expr_parser * p) {
+    int type = parse_and(p);
+    while (match(p, "||")) {
+        if (type != EXPR_BOOL || parse_and(p) != EXPR_BOOL) return -1;
+        emit(p, EXPR_OR, 2, 0, 0);
+    }
+    return type;
+}
+
+// Compile text into e. Column names are looked up in names, and each column's index in it is the
+//     one read from cols by eval_expression(). Returns 1 if text isn't a valid expression, or if
+//     it needs more than EXPR_MAXDEPTH values on its stack.
+int compile_expression(const char * text, const char * names[], int nnames, expression * e) {
+    e->code.clear();
+    e->depth = 0;
+
+    expr_parser p;
+    p.pos    = text;
+    p.names  = names;
+    p.nnames = nnames;
+    p.e      = e;
+    p.depth  = 0;
+
+    e->type = parse_or(&p);
+    while (isspace(* p.pos)) p.pos++;
+    if (e->type == -1 || * p.pos != '\0' || e->depth > EXPR_MAXDEPTH) return 1;
+    return 0;
+}
+
+// Flag the columns read by an expression in use. Columns past ncols are ignored.
+int expression_columns(const expression * e, bool use[], int ncols) {
+    for (const expr_instr &ins : e->code) {
+        if (ins.op == EXPR_COL && ins.col < ncols) use[ins.col] = true;
+    }
+    return 0;
+}
+
+// Evaluate an expression over rows first to first+n, running each instruction over all of them
+//     before moving to the next one. Intermediate values are kept in scratch, which must hold
+//     depth*n values.
+int eval_rows(const expression * e, const float * const cols[], long first, long n, float * out,
+              std::vector<float> * scratch) {
+    // Columns are read in place, so each stack slot points to either a column or its own scratch.
+    const float * stack[EXPR_MAXDEPTH];
+    int sp = 0;
+    for (const expr_instr &ins : e->code) {
+        if (ins.op == EXPR_COL) {
+            stack[sp++] = cols[ins.col] + first;
+            continue;
+        }
+        if (ins.op == EXPR_CONST) {
+            float * d = &((* scratch)[sp * n]);
+            for (long ri = 0; ri < n; ++ri) d[ri] = ins.value;
+            stack[sp++] = d;
+            continue;
+        }
+
+        // Unary instructions.
+        float       * d = &((* scratch)[(sp-1) * n]);
+        const float * a = stack[sp-1];
+        bool unary = true;
+        switch (ins.op) {
+            case EXPR_NEG:  for (long ri = 0; ri < n; ++ri) d[ri] = -a[ri];       break;
+            case EXPR_NOT:  for (long ri = 0; ri < n; ++ri) d[ri] = 1 - a[ri];    break;
+            case EXPR_ABS:  for (long ri = 0; ri < n; ++ri) d[ri] = fabsf(a[ri]); break;
+            case EXPR_SQRT: for (long ri = 0; ri < n; ++ri) d[ri] = sqrtf(a[ri]); break;
+            case EXPR_EXP:  for (long ri = 0; ri < n; ++ri) d[ri] = expf(a[ri]);  break;
+            case EXPR_LOG:  for (long ri = 0; ri < n; ++ri) d[ri] = logf(a[ri]);  break;
+            case EXPR_SIN:  for (long ri = 0; ri < n; ++ri) d[ri] = sinf(a[ri]);  break;
+            case EXPR_COS:  for (long ri = 0; ri < n; ++ri) d[ri] = cosf(a[ri]);  break;
+            case EXPR_TAN:  for (long ri = 0; ri < n; ++ri) d[ri] = tanf(a[ri]);  break;
+            default:        unary = false;                                        break;
+        }
+        if (unary) {
+            stack[sp-1] = d;
+            continue;
+        }
+
+        // Binary instructions. Booleans are always 0 or 1, so logic is done without branching.
+        d = &((* scratch)[(sp-2) * n]);
+        a = stack[sp-2];
+        const float * b = stack[sp-1];
+        switch (ins.op) {
+            case EXPR_ADD:   for (long ri = 0; ri < n; ++ri) d[ri] = a[ri] +  b[ri];        break;
+            case EXPR_SUB:   for (long ri = 0; ri < n; ++ri) d[ri] = a[ri] -  b[ri];        break;
+            case EXPR_MUL:   for (long ri = 0; ri < n; ++ri) d[ri] = a[ri] *  b[ri];        break;
+            case EXPR_DIV:   for (long ri = 0; ri < n; ++ri) d[ri] = a[ri] /  b[ri];        break;
+            case EXPR_LT:    for (long ri = 0; ri < n; ++ri) d[ri] = a[ri] <  b[ri];        break;
+            case EXPR_LE:    for (long ri = 0; ri < n; ++ri) d[ri] = a[ri] <= b[ri];        break;
+            case EXPR_GT:    for (long ri = 0; ri < n; ++ri) d[ri] = a[ri] >  b[ri];        break;
+            case EXPR_GE:    for (long ri = 0; ri < n; ++ri) d[ri] = a[ri] >= b[ri];        break;
+            case EXPR_EQ:    for (long ri = 0; ri < n; ++ri) d[ri] = a[ri] == b[ri];        break;
+            case EXPR_NE:    for (long ri = 0; ri < n; ++ri) d[ri] = a[ri] != b[ri];        break;
+            case EXPR_AND:   for (long ri = 0; ri < n; ++ri) d[ri] = a[ri] * b[ri];         break;
+            case EXPR_OR:    for (long ri = 0; ri < n; ++ri) d[ri] = fmaxf(a[ri], b[ri]);   break;
+            case EXPR_ATAN2: for (long ri = 0; ri < n; ++ri) d[ri] = atan2f(a[ri], b[ri]);  break;
+            case EXPR_POW:   for (long ri = 0; ri < n; ++ri) d[ri] = powf(a[ri], b[ri]);    break;
+            case EXPR_MIN:   for (long ri = 0; ri < n; ++ri) d[ri] = fminf(a[ri], b[ri]);   break;
+            case EXPR_MAX:   for (long ri = 0; ri < n; ++ri) d[ri] = fmaxf(a[ri], b[ri]);   break;
+            default:                                                                        break;
+        }
+        stack[sp-2] = d;
+        sp--;
+    }
+
+    memcpy(out, stack[0], n * sizeof(float));
+    return 0;
+}
+
+// Evaluate an expression over n rows, writing its value for each to out. Booleans are written as 0
+//     or 1. Column ci is read from cols[ci]. Rows are taken EXPR_CHUNK at a time, so that all
+//     intermediate values stay in cache, and they're kept in scratch so that it can be reused
+//     between calls.
+int eval_expression(const expression * e, const float * const cols[], long n, float * out,
+                    std::vector<float> * scratch) {
+    if ((long) scratch->size() < e->depth * EXPR_CHUNK) scratch->resize(e->depth * EXPR_CHUNK);
+    for (long first = 0; first < n; first += EXPR_CHUNK) {
+        long nrows = n - first < EXPR_CHUNK ? n - first : EXPR_CHUNK;
+        eval_rows(e, cols, first, nrows, &(out[first]), scratch);
+    }
+    return 0;
+}
@@ -14,17 +14,17 @@
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <algorithm>
+#include <atomic>
 #include <map>
 #include <math.h>
+#include <thread>
+#include <time.h>
+#include <vector>
 
-#include <TCanvas.h>
 #include <TFile.h>
-#include <TF1.h>
-#include <TGraphErrors.h>
 #include <TH1.h>
-#include <TH1F.h>
-#include <TH2F.h>
-#include <TStyle.h>
+#include <TROOT.h>
 #include <TTree.h>
 
 #include "../lib/bank_containers.h"
@@ -32,68 +32,18 @@
 #include "../lib/err_handler.h"
 #include "../lib/file_handler.h"
 #include "../lib/io_handler.h"
+#include "../lib/sf_fits.h"
 #include "../lib/utilities.h"
 
-int run(char *in_filename, bool use_fmt, int nevn, int run_no) {
-    gStyle->SetOptFit();
-
+// Fill histograms in h with events from evn_min to evn_max. Each worker opens its own TFile and
+//     bank containers, since reading a TTree isn't thread-safe. Only the worker with show_progress
+//     draws the progress bar.
+int fill_sf_histos(char *in_filename, bool use_fmt, long evn_min, long evn_max,
+                   bool show_progress, sf_histos * h, long * nfills) {
     // Access input file.
     TFile *f_in = TFile::Open(in_filename, "READ");
     if (!f_in || f_in->IsZombie()) return 1;
 
-    // Create and organize histos and name arrays.
-    std::map<const char *, TH1 *> histos;
-
-    const int ncals = sizeof(CALNAME)/sizeof(CALNAME[0]);
-    char *sf1D_name_arr[ncals][NSECTORS][(int) ((SF_PMAX - SF_PMIN)/SF_PSTEP)];
-    char *sf2D_name_arr[ncals][NSECTORS];
-    TGraphErrors *sf_dotgraph[ncals][NSECTORS];
-    char *sf2Dfit_name_arr[ncals][NSECTORS];
-    TF1 *sf_polyfit[ncals][NSECTORS];
-    double sf_fitresults[ncals][NSECTORS][SF_NPARAMS][2];
-
-    int ci = -1;
-    for (const char *cal : SFARR2D) {
-        ci++;
-        for (int si = 0; si < NSECTORS; ++si) {
-            // Initialize dotgraphs.
-            char * tmp_str = Form("%s%d)", cal, si+1);
-            sf2D_name_arr[ci][si] = (char *) malloc(strlen(tmp_str)+1);
-            strncpy(sf2D_name_arr[ci][si], tmp_str, strlen(tmp_str));
-            insert_TH2F(&histos, R_PALL, sf2D_name_arr[ci][si], S_P, S_EDIVP,
-                        200, 0, 10, 200, 0, 0.4);
-            sf_dotgraph[ci][si] = new TGraphErrors();
-            sf_dotgraph[ci][si]->SetMarkerStyle(kFullCircle);
-            sf_dotgraph[ci][si]->SetMarkerColor(kRed);
-
-            // Initialize fits.
-            sf2Dfit_name_arr[ci][si] = (char *) malloc(strlen(tmp_str)+1);
-            strncpy(sf2Dfit_name_arr[ci][si], tmp_str, strlen(tmp_str));
-            sf_polyfit[ci][si] = new TF1(sf2Dfit_name_arr[ci][si],
-                    "[0]*([1]+[2]/x + [3]/(x*x))", SF_PMIN+SF_PSTEP, SF_PMAX-SF_PSTEP);
-                    // "[0]+[1]*x+[2]*x*x+[3]*x*x*x", SF_PMIN+SF_PSTEP, SF_PMAX-SF_PSTEP);
-            sf_polyfit[ci][si]->SetParameter(0 /* p0 */, 0.25);
-            sf_polyfit[ci][si]->SetParameter(1 /* p1 */, 1);
-            sf_polyfit[ci][si]->SetParameter(2 /* p2 */, 0);
-            sf_polyfit[ci][si]->SetParameter(3 /* p3 */, 0);
-        }
-    }
-
-    ci = -1;
-    for (const char *cal : SFARR1D) {
-        ci++;
-        for (int si = 0; si < NSECTORS; ++si) {
-            int pi = -1;
-            for (double p = SF_PMIN; p < SF_PMAX; p += SF_PSTEP) {
-                pi++;
-                char * tmp_str = Form("%s%d (%5.2f < p < %5.2f)", cal, si+1, p, p+SF_PSTEP);
-                sf1D_name_arr[ci][si][pi] = (char *) malloc(strlen(tmp_str)+1);
-                strncpy(sf1D_name_arr[ci][si][pi], tmp_str, strlen(tmp_str));
-                insert_TH1F(&histos, R_PALL, sf1D_name_arr[ci][si][pi], S_EDIVP, 200, 0, 0.4);
-            }
-        }
-    }
-
     // Create TTree and link bank_containers.
     TTree *t = f_in->Get<TTree>("Tree");
     REC_Particle     rp(t);
@@ -102,13 +52,12 @@ int run(char *in_filename, bool use_fmt, int nevn, int run_no) {
     FMT_Tracks       ft(t);
 
     // Iterate through input file. Each TTree entry is one event.
-    int evn;
-    int divcntr = 0;
-    int evnsplitter = 0;
-    printf("Reading %lld events from %s.\n", nevn == -1 ? t->GetEntries() : nevn, in_filename);
-    for (evn = 0; (evn < t->GetEntries()) && (nevn == -1 || evn < nevn); ++evn) {
-        if (evn >= evnsplitter) {
-            if (evn != 0) {
+    long nevn        = evn_max - evn_min;
+    int  divcntr     = 0;
+    long evnsplitter = 0;
+    for (long evn = evn_min; evn < evn_max; ++evn) {
+        if (show_progress && evn - evn_min >= evnsplitter) {
+            if (evn != evn_min) {
                 printf("\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b");
                 printf("\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b");
             }
@@ -120,7 +69,7 @@ int run(char *in_filename, bool use_fmt, int nevn, int run_no) {
             printf("] %2d%%", divcntr);
             fflush(stdout);
             divcntr++;
-            evnsplitter = nevn == -1 ? (t->GetEntries() / 100) * divcntr : (nevn/100) * divcntr;
+            evnsplitter = (nevn/100) * divcntr;
         }
 
         rp.get_entries(t, evn);
@@ -151,8 +100,8 @@ int run(char *in_filename, bool use_fmt, int nevn, int run_no) {
             double tot_P = calc_magnitude(px, py, pz);
 
             // Compute energy deposited in each calorimeter per sector.
-            double sf_E[ncals][NSECTORS];
-            for (int ci = 0; ci < ncals; ++ci) {
+            double sf_E[SF_NCALS][NSECTORS];
+            for (int ci = 0; ci < SF_NCALS; ++ci) {
                 for (int si = 0; si < NSECTORS; ++si) sf_E[ci][si] = 0;
             }
 
@@ -173,152 +122,298 @@ int run(char *in_filename, bool use_fmt, int nevn, int run_no) {
                 }
             }
 
-            for (int ci = 0; ci < ncals-1; ++ci) {
-                for (int si = 0; si < NSECTORS; ++si) sf_E[CALS_IDX][si] += sf_E[ci][si];
-            }
+            fill_sf_track(h, tot_P, sf_E, nfills);
+        }
+    }
+    if (show_progress) {
+        printf("\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b");
+        printf("\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b");
+        printf("[==================================================] 100%%\n");
+    }
 
-            // Get momentum bin.
-            if (tot_P < SF_PMIN || tot_P > SF_PMAX) continue;
-            int pi = -1;
-            for (double p_cnt = SF_PMIN; p_cnt <= SF_PMAX; p_cnt += SF_PSTEP) {
-                if (tot_P < p_cnt) break;
-                pi++;
-            }
+    f_in->Close();
+    return 0;
+}
+
+// Range of events of an input file read by one worker.
+typedef struct {
+    int  fi;      // Input file index.
+    int  ri;      // Index of the file's run.
+    long evn_min;
+    long evn_max;
+} sf_task;
+
+// Fill, fit, and save one set of histograms for each run in in_files. If period_no isn't -1, all
+//     runs are also added together and fitted as a run period, saved with period_no as run number.
+//     If precision is positive, each run's files are read check_nevn events at a time, and reading
+//     stops once the uncertainties of all fast fit parameters are below precision. If seed_file
+//     isn't NULL, Minuit fits start from the results it holds.
+int run(char **in_files, int *run_nos, int nfiles, int *bad_file, bool use_fmt, int nevn,
+        int nthreads, bool fast_fit, bool cmp_fits, char *state_file, int period_no,
+        double precision, long check_nevn, char *seed_file) {
+    // Index runs in ascending order.
+    std::map<int, int> run_idx;
+    std::vector<int> runs;
+    for (int fi = 0; fi < nfiles; ++fi) run_idx[run_nos[fi]] = -1;
+    for (auto &r : run_idx) {
+        r.second = runs.size();
+        runs.push_back(r.first);
+    }
+    int nruns = runs.size();
+
+    // Get fit seeds.
+    sf_seeds  seeds_buf;
+    sf_seeds *seeds = NULL;
+    if (seed_file != NULL) {
+        if (get_sf_seeds(&seeds_buf, seed_file)) return 6;
+        seeds = &seeds_buf;
+    }
 
-            // Write to histograms.
-            for (int ci = 0; ci < ncals; ++ci) {
-                for (int si = 0; si < NSECTORS; ++si) {
-                    if (sf_E[ci][si] <= 0) continue;
-                    histos[sf2D_name_arr[ci][si]]->Fill(tot_P, sf_E[ci][si]/tot_P);
-                    histos[sf1D_name_arr[ci][si][pi]]->Fill(sf_E[ci][si]/tot_P);
+    // Count entries in each file and list the files of each run.
+    std::vector<long> nentries(nfiles);
+    std::vector<std::vector<int>> run_files(nruns);
+    long nentries_tot = 0;
+    for (int fi = 0; fi < nfiles; ++fi) {
+        * bad_file = fi;
+        TFile *f_in = TFile::Open(in_files[fi], "READ");
+        if (!f_in || f_in->IsZombie()) return 1;
+        TTree *t = f_in->Get<TTree>("Tree");
+        nentries[fi] = (nevn == -1 || nevn > t->GetEntries()) ? t->GetEntries() : nevn;
+        f_in->Close();
+
+        run_files[run_idx[run_nos[fi]]].push_back(fi);
+        nentries_tot += nentries[fi];
+    }
+
+    // Workers book their own histogram set for a run the first time they read from it, and empty
+    //     it into the run's set after each round. Histograms are kept out of ROOT's directories so
+    //     that workers don't share any state.
+    TH1::AddDirectory(kFALSE);
+    if (nthreads > 1) ROOT::EnableThreadSafety();
+    std::vector<std::vector<sf_histos *>> sf_h(nthreads, std::vector<sf_histos *>(nruns, NULL));
+    std::vector<sf_histos *> run_h(nruns);
+    for (int ri = 0; ri < nruns; ++ri) {
+        run_h[ri] = new sf_histos;
+        book_sf_histos(run_h[ri]);
+    }
+
+    // Fast fits used to check the precision reached by each run.
+    TGraphErrors *chk_dotgraph[SF_NCALS][NSECTORS];
+    TF1 *chk_polyfit[SF_NCALS][NSECTORS];
+    if (precision > 0) init_sf_fits(chk_dotgraph, chk_polyfit, " check");
+    else               check_nevn = nentries_tot;
+
+    // Position of the next event to read from each run, as a file and an entry in that file.
+    std::vector<UInt_t> run_fpos(nruns, 0);
+    std::vector<long>   run_epos(nruns, 0);
+    std::vector<long>   run_nevents(nruns, 0);
+    std::vector<bool>   run_done(nruns, false);
+    std::vector<double> run_err(nruns, INFINITY);
+
+    std::vector<long> nfills(nthreads, 0);
+    long nread = 0;
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    printf("Reading up to %ld events from %d file(s) of %d run(s) with %d thread(s).\n",
+           nentries_tot, nfiles, nruns, nthreads);
+    while (true) {
+        // Take the next check_nevn events of each run that's not done, then split them so that all
+        //     threads have work to do.
+        std::vector<sf_task> round;
+        for (int ri = 0; ri < nruns; ++ri) {
+            long left = check_nevn;
+            while (!run_done[ri] && left > 0 && run_fpos[ri] < run_files[ri].size()) {
+                int  fi = run_files[ri][run_fpos[ri]];
+                long n  = std::min(left, nentries[fi] - run_epos[ri]);
+                if (n > 0) round.push_back({fi, ri, run_epos[ri], run_epos[ri] + n});
+                run_epos[ri]    += n;
+                run_nevents[ri] += n;
+                left            -= n;
+                if (run_epos[ri] == nentries[fi]) {
+                    run_fpos[ri]++;
+                    run_epos[ri] = 0;
                 }
             }
         }
-    }
-    printf("\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b");
-    printf("\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b");
-    printf("[==================================================] 100%%\n");
-
-    // Fit histograms.
-    ci = -1;
-    for (const char *cal : SFARR1D) {
-        ci++;
-        for (int si = 0; si < NSECTORS; ++si) {
-            int pi = -1;
-            int point_index = 0;
-            // Fit 1D plots for each momentum bin to fill dotgraphs.
-            for (double p = SF_PMIN; p < SF_PMAX; p += SF_PSTEP) {
-                pi++;
-
-                // Get ref to histogram.
-                TH1 *EdivP = histos[sf1D_name_arr[ci][si][pi]];
-
-                // Form fit string name.
-                char * tmp_str = Form("%s%d (%5.2f < p < %5.2f) fit", cal, si+1, p, p+SF_PSTEP);
-
-                // Fit.
-                TF1 *sf_gaus = new TF1(tmp_str,
-                                       "[0]*TMath::Gaus(x,[1],[2]) + [3]*x*x + [4]*x + [5]",
-                                       PLIMITSARR[ci][0], PLIMITSARR[ci][1]);
-                sf_gaus->SetParameter(0 /* amp   */, EdivP->GetBinContent(EdivP->GetMaximumBin()));
-                sf_gaus->SetParLimits(1, PLIMITSARR[ci][0], PLIMITSARR[ci][1]);
-                sf_gaus->SetParameter(1 /* mean  */, (PLIMITSARR[ci][1] + PLIMITSARR[ci][0])/2);
-                sf_gaus->SetParLimits(2, 0., 0.1);
-                sf_gaus->SetParameter(2 /* sigma */, 0.05);
-                sf_gaus->SetParameter(3 /* p0 */,    0);
-                sf_gaus->SetParameter(4 /* p1 */,    0);
-                sf_gaus->SetParameter(5 /* p2 */,    0);
-                EdivP->Fit(sf_gaus, "QR", "", PLIMITSARR[ci][0], PLIMITSARR[ci][1]);
-
-                // Extract mean and sigma from fit and add it to 2D plots.
-                double mean  = sf_gaus->GetParameter(1);
-                double sigma = sf_gaus->GetParameter(2);
-
-                // Only add points within PLIMITSARR borders and with an acceptable chi2.
-                if ((mean - 2*sigma > PLIMITSARR[ci][0] && mean + 2*sigma < PLIMITSARR[ci][1]) &&
-                    (sf_gaus->GetChisquare() / sf_gaus->GetNDF() < SF_CHI2CONFORMITY)) {
-                        // Older root compatibility fix
-                        sf_dotgraph[ci][si]->SetPoint(point_index, p + SF_PSTEP/2, mean); point_index++;
+        if (round.size() == 0) break;
+
+        int nsplit = nthreads > (int) round.size() ? (nthreads + round.size() - 1)/round.size() : 1;
+        std::vector<sf_task> tasks;
+        for (sf_task &tk : round) {
+            long n = tk.evn_max - tk.evn_min;
+            for (int si = 0; si < nsplit; ++si) {
+                tasks.push_back({tk.fi, tk.ri, tk.evn_min + (n*si)/nsplit,
+                                 tk.evn_min + (n*(si+1))/nsplit});
+            }
+            nread += n;
+        }
+        int ntasks = tasks.size();
+
+        // Fill histograms, with workers taking tasks in order until none are left.
+        std::vector<int> status(ntasks, 0);
+        std::atomic<int> next_task(0);
+        bool show_progress = ntasks == 1 && precision <= 0;
+        auto work = [&](int wi) {
+            for (int ti = next_task++; ti < ntasks; ti = next_task++) {
+                sf_task *tk = &(tasks[ti]);
+                if (sf_h[wi][tk->ri] == NULL) {
+                    sf_h[wi][tk->ri] = new sf_histos;
+                    book_sf_histos(sf_h[wi][tk->ri]);
+                }
+                status[ti] = fill_sf_histos(in_files[tk->fi], use_fmt, tk->evn_min, tk->evn_max,
+                                            show_progress, sf_h[wi][tk->ri], &(nfills[wi]));
+                if (!show_progress && status[ti] == 0) {
+                    printf("Read events %ld to %ld of %s (run %d).\n", tk->evn_min, tk->evn_max,
+                           in_files[tk->fi], runs[tk->ri]);
                 }
             }
+        };
+        if (nthreads == 1) {
+            work(0);
+        }
+        else {
+            std::vector<std::thread> workers;
+            for (int wi = 0; wi < nthreads; ++wi) workers.push_back(std::thread(work, wi));
+            for (int wi = 0; wi < nthreads; ++wi) workers[wi].join();
+        }
+        for (int ti = 0; ti < ntasks; ++ti) {
+            * bad_file = tasks[ti].fi;
+            if (status[ti]) return status[ti];
+        }
 
-            // Fit dotgraphs.
-            if (sf_dotgraph[ci][si]->GetN() > 0)
-                sf_dotgraph[ci][si]->Fit(sf_polyfit[ci][si], "QR", "",
-                                         SF_PMIN+SF_PSTEP, SF_PMAX-SF_PSTEP);
-
-            // Extract and save dotgraph fits parameters to make cuts from them.
-            for (int pi = 0; pi < sf_polyfit[ci][si]->GetNpar(); ++pi) {
-                sf_fitresults[ci][si][pi][0] = sf_polyfit[ci][si]->GetParameter(pi); // sf.
-                sf_fitresults[ci][si][pi][1] = sf_polyfit[ci][si]->GetParError(pi);  // sfs.
+        // Empty the workers' histograms into each run's set. Histograms are unweighted, so bin
+        //     contents are integer counts and the merge doesn't depend on which worker read which
+        //     task.
+        for (int wi = 0; wi < nthreads; ++wi) {
+            for (int ri = 0; ri < nruns; ++ri) {
+                if (sf_h[wi][ri] == NULL) continue;
+                merge_sf_histos(run_h[ri], sf_h[wi][ri]);
+                reset_sf_histos(sf_h[wi][ri]);
             }
         }
+
+        // Check which runs reached the requested precision.
+        for (int ri = 0; ri < nruns; ++ri) {
+            if (run_done[ri]) continue;
+            if (run_fpos[ri] == run_files[ri].size()) run_done[ri] = true;
+            if (precision <= 0) continue;
+
+            run_err[ri] = sf_max_error(run_h[ri], chk_dotgraph, chk_polyfit);
+            if (run_err[ri] < precision) run_done[ri] = true;
+            printf("Run %06d: %ld events read, max parameter error %.2e.\n", runs[ri],
+                   run_nevents[ri], run_err[ri]);
+        }
+    }
+    for (int wi = 0; wi < nthreads; ++wi) {
+        for (int ri = 0; ri < nruns; ++ri) {
+            if (sf_h[wi][ri] == NULL) continue;
+            free_sf_histos(sf_h[wi][ri]);
+            delete sf_h[wi][ri];
+        }
     }
 
-    // Create output file.
-    char*  out_filename = (char *) malloc(128 * sizeof(char));
-    sprintf(out_filename, "../root_io/sf_study_%06d.root", run_no);
-    
-    TFile *f_out = TFile::Open(out_filename, "RECREATE");
-    // Write to output file.
-    TString dir;
-    TCanvas *gcvs = new TCanvas();
-    for (ci = 0; ci < ncals; ++ci) {
-        dir = Form("%s", CALNAME[ci]);
-        f_out->mkdir(dir);
-        f_out->cd(dir);
-        for (int si = 0; si < NSECTORS; ++si) {
-            dir = Form("%s/sector %d", CALNAME[ci], si+1);
-            f_out->mkdir(dir);
-            f_out->cd(dir);
-
-            histos[sf2D_name_arr[ci][si]]->Draw("colz");
-            sf_dotgraph[ci][si]->Draw("Psame");
-            sf_polyfit[ci][si]->Draw("same");
-            gcvs->Write(sf2D_name_arr[ci][si]);
-            free(sf2D_name_arr[ci][si]);
-            for (int pi = 0; pi < ((int) ((SF_PMAX - SF_PMIN)/SF_PSTEP)); ++pi) {
-                histos[sf1D_name_arr[ci][si][pi]]->Write();
-                free(sf1D_name_arr[ci][si][pi]);
+    long nfills_tot = 0;
+    for (int wi = 0; wi < nthreads; ++wi) nfills_tot += nfills[wi];
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    double fill_s = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec)*1e-9;
+    printf("Filled %ld entries in %.2f s (%.2f M fills/s).\n", nfills_tot, fill_s,
+           fill_s > 0 ? nfills_tot/fill_s*1e-6 : 0.);
+
+    // Report the events needed by each run to reach the requested precision.
+    if (precision > 0) {
+        printf("\n%-8s %12s %12s %12s %s\n", "run", "needed", "available", "max error",
+               "converged");
+        for (int ri = 0; ri < nruns; ++ri) {
+            long available = 0;
+            for (int fi : run_files[ri]) available += nentries[fi];
+            printf("%06d   %12ld %12ld %12.2e %s\n", runs[ri], run_nevents[ri], available,
+                   run_err[ri], run_err[ri] < precision ? "yes" : "no");
+        }
+        printf("Read %ld of %ld events (%.1f%%).\n", nread, nentries_tot,
+               nentries_tot > 0 ? 100.*nread/nentries_tot : 0.);
+        for (int ci = 0; ci < SF_NCALS; ++ci) {
+            for (int si = 0; si < NSECTORS; ++si) {
+                delete chk_dotgraph[ci][si];
+                delete chk_polyfit[ci][si];
             }
-            free(sf2Dfit_name_arr[ci][si]);
         }
     }
 
-    // Write results to file.
-    FILE *t_out = fopen(Form("../data/sf_params_%06d.txt", run_no), "w");
+    // Add all runs together for the run period fit.
+    sf_histos *period_h = NULL;
+    if (period_no != -1) {
+        period_h = new sf_histos;
+        book_sf_histos(period_h);
+        for (int ri = 0; ri < nruns; ++ri) merge_sf_histos(period_h, run_h[ri]);
+    }
 
-    if (t_out == NULL) return 4;
-    for (int ci = 3; ci < 4; ++ci) { // NOTE. Only writing ECAL sf results.
-        for (int si = 0; si < NSECTORS; ++si) {
-            for (int ppi = 0; ppi < 2; ++ppi) { // sf and sfs.
-                for (int pi = 0; pi < SF_NPARAMS; ++pi) {
-                    fprintf(t_out, "%011.8f ", sf_fitresults[ci][si][pi][0]);
-                }
-            }
-            fprintf(t_out, "\n");
-        }
+    // Save each run's state so that it can be merged with other files by merge_sf, then fit its
+    //     histograms and save the results. state_file is only given for a single run without a run
+    //     period, and the period's number never matches a run's, so no state overwrites another.
+    char run_state_file[128];
+    for (int ri = 0; ri < nruns; ++ri) {
+        printf("\n=== RUN %06d (%ld events) ===\n", runs[ri], run_nevents[ri]);
+        if (state_file != NULL) snprintf(run_state_file, sizeof(run_state_file), "%s", state_file);
+        else snprintf(run_state_file, sizeof(run_state_file), "../root_io/sf_state_%06d.root",
+                      runs[ri]);
+        if (write_sf_state(run_h[ri], run_state_file, runs[ri], use_fmt, run_nevents[ri]))
+            return 5;
+        printf("Saved histograms to %s.\n", run_state_file);
+
+        if (fit_and_save_sf(run_h[ri], runs[ri], fast_fit, cmp_fits, nthreads, seeds)) return 4;
+        free_sf_histos(run_h[ri]);
+        delete run_h[ri];
     }
 
-    fclose(t_out);
-    f_in ->Close();
-    f_out->Close();
-    free(in_filename);
-    free(out_filename);
+    // Same for the run period.
+    if (period_h != NULL) {
+        printf("\n=== PERIOD %06d (%d runs, %ld events) ===\n", period_no, nruns, nread);
+        snprintf(run_state_file, sizeof(run_state_file), "../root_io/sf_state_%06d.root",
+                 period_no);
+        if (write_sf_state(period_h, run_state_file, period_no, use_fmt, nread)) return 5;
+        printf("Saved histograms to %s.\n", run_state_file);
+
+        if (fit_and_save_sf(period_h, period_no, fast_fit, cmp_fits, nthreads, seeds)) return 4;
+        free_sf_histos(period_h);
+        delete period_h;
+    }
 
     return 0;
 }
 
 // Call program from terminal, C-style.
 int main(int argc, char **argv) {
-    bool use_fmt      = false;
-    int nevn          = -1;
-    char *in_filename = NULL;
-    int run_no        = -1;
-
-    if (extractsf_handle_args_err(extractsf_handle_args(argc, argv, &use_fmt, &nevn, &in_filename,
-        &run_no), &in_filename))
+    bool use_fmt     = false;
+    int nevn         = -1;
+    char **in_files  = NULL;
+    int *run_nos     = NULL;
+    int nfiles       = 0;
+    int nthreads     = 1;
+    bool fast_fit    = false;
+    bool cmp_fits    = false;
+    char *state_file = NULL;
+    int period_no    = -1;
+    double precision = -1;
+    long check_nevn  = SF_CHECK_NEVN;
+    char *seed_file  = NULL;
+
+    if (extractsf_handle_args_err(extractsf_handle_args(argc, argv, &use_fmt, &nevn, &in_files,
+            &run_nos, &nfiles, &nthreads, &fast_fit, &cmp_fits, &state_file, &period_no, &precision,
+            &check_nevn, &seed_file), in_files, run_nos, nfiles, &state_file, &seed_file))
         return 1;
 
-    return extractsf_err(run(in_filename, use_fmt, nevn, run_no), &in_filename);
+    int bad_file = -1;
+    int errcode  = run(in_files, run_nos, nfiles, &bad_file, use_fmt, nevn, nthreads, fast_fit,
+                       cmp_fits, state_file, period_no, precision, check_nevn, seed_file);
+    if (errcode) {
+        return extractsf_err(errcode, in_files, run_nos, nfiles, bad_file, &state_file,
+                             &seed_file);
+    }
+
+    for (int fi = 0; fi < nfiles; ++fi) free(in_files[fi]);
+    free(in_files);
+    free(run_nos);
+    free(state_file);
+    free(seed_file);
+    return 0;
 }
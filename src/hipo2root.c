@@ -45,6 +45,7 @@ int main(int argc, char **argv) {
     f->SetCompressionAlgorithm(ROOT::kLZ4);
 
     TTree *tree = new TTree("Tree", "Tree");
+    RUN_Config       rcfg;  rcfg .link_branches(tree);
     REC_Particle     rpart; rpart.link_branches(tree);
     REC_Track        rtrk;  rtrk .link_branches(tree);
     REC_Calorimeter  rcal;  rcal .link_branches(tree);
@@ -59,6 +60,7 @@ int main(int argc, char **argv) {
     hipo::dictionary factory;
     reader.readDictionary(factory);
 
+    hipo::bank rcfg_b( factory.getSchema("RUN::config"));
     hipo::bank rpart_b(factory.getSchema("REC::Particle"));
     hipo::bank rtrk_b( factory.getSchema("REC::Track"));
     hipo::bank rcal_b( factory.getSchema("REC::Calorimeter"));
@@ -77,12 +79,14 @@ int main(int argc, char **argv) {
         }
         reader.read(event);
 
+        event.getStructure(rcfg_b);  rcfg .fill(rcfg_b);
         event.getStructure(rpart_b); rpart.fill(rpart_b);
         event.getStructure(rtrk_b);  rtrk .fill(rtrk_b);
         event.getStructure(rcal_b);  rcal .fill(rcal_b);
         event.getStructure(rche_b);  rche .fill(rche_b);
         event.getStructure(rsci_b);  rsci .fill(rsci_b);
         event.getStructure(ftrk_b);  ftrk .fill(ftrk_b);
+        // RUN::config is in every event, so it doesn't count towards skipping empty ones.
         if (rpart.get_nrows() + rtrk.get_nrows() + rcal.get_nrows()
                 + rche.get_nrows()  + rsci.get_nrows() + ftrk.get_nrows() > 0)
             tree->Fill();
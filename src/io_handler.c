@@ -13,14 +13,15 @@
 
 #include "../lib/io_handler.h"
 
-int make_ntuples_handle_args(int argc, char ** argv, bool * debug, int * nevents,
-                             char ** input_file, int * run_no, double * beam_energy) {
+int make_ntuples_handle_args(int argc, char ** argv, bool * debug, long * nevents,
+                             char ** input_file, int * run_no, double * beam_energy, bool * fused) {
     // Handle optional arguments.
     int opt;
-    while ((opt = getopt(argc, argv, "-dn:")) != -1) {
+    while ((opt = getopt(argc, argv, "-dxn:")) != -1) {
         switch (opt) {
             case 'd': * debug     = true;         break;
-            case 'n': * nevents   = atoi(optarg); break;
+            case 'x': * fused     = true;         break;
+            case 'n': * nevents   = atol(optarg); break;
             case  1 :{
                 * input_file = (char *) malloc(strlen(optarg) + 1);
                 strcpy(* input_file, optarg);
@@ -29,7 +30,7 @@ int make_ntuples_handle_args(int argc, char ** argv, bool * debug, int * nevents
             default:  return 1; // Bad usage of optional arguments.
         }
     }
-    if (* nevents == 0) return 2; // Check that nevents is valid and atoi performed correctly.
+    if (* nevents == 0) return 2; // Check that nevents is valid and atol performed correctly.
 
     // Handle positional argument.
     if (argc < 2) return 7;
@@ -38,25 +39,108 @@ int make_ntuples_handle_args(int argc, char ** argv, bool * debug, int * nevents
 }
 
 int extractsf_handle_args(int argc, char ** argv, bool * use_fmt, int * nevents,
-                          char ** input_file, int * run_no) {
+                          char *** in_files, int ** run_nos, int * nfiles, int * nthreads,
+                          bool * fast_fit, bool * cmp_fits, char ** state_file, int * period_no,
+                          double * precision, long * check_nevn, char ** seed_file) {
+    * in_files = (char **) malloc(argc * sizeof(char *));
+    * run_nos  = (int *)   malloc(argc * sizeof(int));
+
     // Handle optional arguments.
     int opt;
-    while ((opt = getopt(argc, argv, "-fn:")) != -1) {
+    while ((opt = getopt(argc, argv, "-fn:j:aco:p:e:k:s:")) != -1) {
         switch (opt) {
-            case 'f': * use_fmt = true;         break;
-            case 'n': * nevents = atoi(optarg); break;
+            case 'f': * use_fmt   = true;         break;
+            case 'a': * fast_fit  = true;         break;
+            case 'c': * cmp_fits  = true;         break;
+            case 'n': * nevents   = atoi(optarg); break;
+            case 'j': * nthreads  = atoi(optarg); break;
+            case 'k': * check_nevn = atol(optarg); break;
+            case 'p':{
+                // -1 means PERIOD or PRECISION weren't given, so they're checked as they're read.
+                * period_no = atoi(optarg);
+                if (* period_no <= 0) return 9;
+                break;
+            }
+            case 'e':{
+                * precision = atof(optarg);
+                if (* precision <= 0) return 10;
+                break;
+            }
+            case 'o':{
+                * state_file = (char *) malloc(strlen(optarg) + 1);
+                strcpy(* state_file, optarg);
+                break;
+            }
+            case 's':{
+                * seed_file = (char *) malloc(strlen(optarg) + 1);
+                strcpy(* seed_file, optarg);
+                break;
+            }
             case  1 :{
-                * input_file = (char *) malloc(strlen(optarg) + 1);
-                strcpy(* input_file, optarg);
+                (* in_files)[* nfiles] = (char *) malloc(strlen(optarg) + 1);
+                strcpy((* in_files)[* nfiles], optarg);
+                (* nfiles)++;
+                int chk = handle_root_filename(optarg, &((* run_nos)[* nfiles - 1]));
+                if (chk) return chk < 5 ? chk : 7;
                 break;
             }
             default:  return 1;
         }
     }
     if (* nevents == 0) return 2;
-    if (argc < 2) return 5;
+    if (* nthreads < 1) return 6;
+    if (* nfiles == 0)  return 5;
+    if (* check_nevn < 1) return 11;
 
-    return handle_root_filename(* input_file, run_no);
+    // A single state file can only be given if all files are from the same run, and no run period
+    //     state is written next to it.
+    if (* state_file != NULL) {
+        for (int fi = 1; fi < * nfiles; ++fi) if ((* run_nos)[fi] != (* run_nos)[0]) return 8;
+        if (* period_no != -1) return 12;
+    }
+
+    // The run period's state and results would overwrite those of a run with the same number.
+    for (int fi = 0; fi < * nfiles; ++fi) if ((* run_nos)[fi] == * period_no) return 13;
+
+    return 0;
+}
+
+int merge_sf_handle_args(int argc, char ** argv, int * nthreads, bool * fast_fit, bool * cmp_fits,
+                         char ** out_file, char ** seed_file, char *** in_files, int * nfiles) {
+    * in_files = (char **) malloc(argc * sizeof(char *));
+
+    // Handle optional arguments.
+    int opt;
+    while ((opt = getopt(argc, argv, "-j:aco:s:")) != -1) {
+        switch (opt) {
+            case 'j': * nthreads = atoi(optarg); break;
+            case 'a': * fast_fit = true;         break;
+            case 'c': * cmp_fits = true;         break;
+            case 'o':{
+                * out_file = (char *) malloc(strlen(optarg) + 1);
+                strcpy(* out_file, optarg);
+                break;
+            }
+            case 's':{
+                * seed_file = (char *) malloc(strlen(optarg) + 1);
+                strcpy(* seed_file, optarg);
+                break;
+            }
+            case  1 :{
+                (* in_files)[* nfiles] = (char *) malloc(strlen(optarg) + 1);
+                strcpy((* in_files)[* nfiles], optarg);
+                (* nfiles)++;
+                int chk = check_root_filename(optarg);
+                if (chk) return chk;
+                break;
+            }
+            default:  return 1;
+        }
+    }
+    if (* nthreads < 1) return 2;
+    if (* nfiles == 0)  return 5;
+
+    return 0;
 }
 
 int hipo2root_handle_args(int argc, char ** argv, char ** input_file, int * run_no) {
@@ -69,6 +153,75 @@ int hipo2root_handle_args(int argc, char ** argv, char ** input_file, int * run_
     return handle_hipo_filename(* input_file, run_no);
 }
 
+int audit_kinematics_handle_args(int argc, char ** argv, int * nevents) {
+    // Handle optional arguments.
+    int opt;
+    while ((opt = getopt(argc, argv, "n:")) != -1) {
+        switch (opt) {
+            case 'n': * nevents = atoi(optarg); break;
+            default:  return 1;
+        }
+    }
+    if (* nevents <= 0) return 2;
+
+    return 0;
+}
+
+int audit_selection_handle_args(int argc, char ** argv, int * nruns, long long * nevents) {
+    // Handle optional arguments.
+    int opt;
+    while ((opt = getopt(argc, argv, "r:n:")) != -1) {
+        switch (opt) {
+            case 'r': * nruns   = atoi(optarg);  break;
+            case 'n': * nevents = atoll(optarg); break;
+            default:  return 1;
+        }
+    }
+    if (* nruns < 1) return 2;
+    if (* nevents < 1 || * nevents > (1LL << (EVNKEY_BITS-1))) return 3;
+
+    return 0;
+}
+
+int draw_plots_handle_args(int argc, char ** argv, int * nthreads, bool * all_cols,
+                           bool * per_row, char ** config_file, char *** in_files, int * nfiles) {
+    * in_files = (char **) malloc((argc + 1) * sizeof(char *));
+
+    // Handle optional arguments.
+    int opt;
+    while ((opt = getopt(argc, argv, "-arj:c:")) != -1) {
+        switch (opt) {
+            case 'a': * all_cols = true;         break;
+            case 'r': * per_row  = true;         break;
+            case 'j': * nthreads = atoi(optarg); break;
+            case 'c':
+                free(* config_file);
+                * config_file = (char *) malloc(strlen(optarg) + 1);
+                strcpy(* config_file, optarg);
+                break;
+            case  1 :{
+                (* in_files)[* nfiles] = (char *) malloc(strlen(optarg) + 1);
+                strcpy((* in_files)[* nfiles], optarg);
+                (* nfiles)++;
+                int chk = check_root_filename(optarg);
+                if (chk) return chk;
+                break;
+            }
+            default:  return 1;
+        }
+    }
+    if (* nthreads < 1) return 2;
+
+    // Default to the ntuples written by make_ntuples.
+    if (* nfiles == 0) {
+        (* in_files)[0] = (char *) malloc(strlen(DRAW_INFILE) + 1);
+        strcpy((* in_files)[0], DRAW_INFILE);
+        (* nfiles)++;
+    }
+
+    return 0;
+}
+
 int check_root_filename(char * input_file) {
     if (!strstr(input_file, ".root"))     return 3; // Check that file is valid.
     if (!(access(input_file, F_OK) == 0)) return 4; // Check that file exists.
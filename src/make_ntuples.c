@@ -15,8 +15,10 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <math.h>
+#include <time.h>
 
 #include <TFile.h>
+#include <TH1.h>
 #include <TNtuple.h>
 #include <TTree.h>
 #include <TROOT.h>
@@ -27,6 +29,7 @@
 #include "../lib/file_handler.h"
 #include "../lib/io_handler.h"
 #include "../lib/particle.h"
+#include "../lib/sf_fits.h"
 #include "../lib/utilities.h"
 
 // Find most precise TOF (Layers precision: FTOF1B, FTOF1A, FTOF2, PCAL, ECIN, ECOU).
@@ -76,9 +79,250 @@ double get_tof(REC_Scintillator rsci, REC_Calorimeter  rcal, int pindex) {
     return tof;
 }
 
-int run(char * in_filename, bool debug, int nevn, int run_no, double beam_E) {
+// Compute kinematics for all buffered rows, write them to the ntuple, and clear the buffers. key is
+//     the address bound to the ntuple's R_EVNKEY branch. If batch_ns isn't NULL, the time taken by
+//     the kinematics is added to it.
+int flush_rows(TNtuple * t, particle_batch * b, std::vector<Float_t> * rows,
+               std::vector<Long64_t> * keys, Long64_t * key, double * batch_ns) {
+    struct timespec t0, t1;
+    if (batch_ns) clock_gettime(CLOCK_MONOTONIC, &t0);
+    particle_batch_kinematics(b);
+    if (batch_ns) {
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        * batch_ns += (t1.tv_sec - t0.tv_sec)*1e9 + (t1.tv_nsec - t0.tv_nsec);
+    }
+
+    for (int i = 0; i < particle_batch_size(b); ++i) {
+        Float_t * v = &(rows->at(i * VAR_LIST_SIZE));
+        v[A_P]       = b->p      [i];
+        v[A_THETA]   = b->theta  [i];
+        v[A_PHI]     = b->phi    [i];
+        v[A_ZH]      = b->zh     [i];
+        v[A_PT2]     = b->pt2    [i];
+        v[A_PL2]     = b->pl2    [i];
+        v[A_PHIPQ]   = b->phipq  [i];
+        v[A_THETAPQ] = b->thetapq[i];
+        * key        = keys->at(i);
+        t->Fill(v);
+    }
+
+    particle_batch_clear(b);
+    rows->clear();
+    keys->clear();
+    return 0;
+}
+
+// Buffer a TNtuple row for particle p with track information t, and add p to the batch that
+//     computes its kinematics. key is the event's (run, event) key.
+int buffer_row(std::vector<Float_t> * rows, std::vector<Long64_t> * keys, particle_batch * b,
+               particle p, dis_kinematics k, track_info * t, int run_no, long long evn,
+               long long key, double beam_E, float tre_tof) {
+    // NOTE. If adding new variables, check their order in S_VAR_LIST.
+    // NOTE. Momentum, angles, and SIDIS variables are filled by flush_rows().
+    Float_t v[VAR_LIST_SIZE] = {
+            (Float_t) run_no, (Float_t) evn, (Float_t) beam_E,
+            (Float_t) p.pid, (Float_t) t->status, (Float_t) p.q, p.mass,
+            p.vx, p.vy, p.vz, p.px, p.py, p.pz,
+            0, 0, 0, p.beta,
+            t->chi2, t->ndf,
+            t->pcal_E, t->ecin_E, t->ecou_E, t->tot_E,
+            (t->tof - tre_tof),
+            Q2(p, beam_E), nu(p, beam_E),
+            Xb(p, beam_E), W2(p, beam_E),
+            0, 0, 0,
+            0, 0
+    };
+    rows->insert(rows->end(), v, v + VAR_LIST_SIZE);
+    keys->push_back(key);
+    particle_batch_add(b, p, k);
+    return 0;
+}
+
+// Output TNtuples, along with the buffers and counters used to fill them.
+typedef struct {
+    TNtuple * t[2]; // DC and FMT.
+    // Rows are buffered in chunks so that their kinematics are computed in batches. Each row's
+    //     kinematics are stored at the same position in the batch.
+    particle_batch       batch[2];
+    std::vector<Float_t> rows [2];
+    // Each row's (run, event) key, written to the R_EVNKEY branch through key when flushing.
+    std::vector<Long64_t> keys[2];
+    Long64_t key;
+    long   batch_n;
+    double batch_ns;
+    // Counters for PID assignment quality assessment, only used in debug mode.
+    bool debug;
+    int  pid_n[NPIDS];
+    int  pid_qa[NPIDS][NPIDS];
+} ntuple_writer;
+
+// Tracks of one event, kept in memory by the fused mode until the sampling fraction is fitted.
+typedef struct {
+    long long evn;
+    float tre_tof;
+    long  first; // Position of the event's first track in the track caches.
+    int   ntrk;
+} cached_event;
+
+// Append the particles and detector information of all tracks in the current event to trk_p and
+//     trk_info. Each track holds its DC particle at 2*pos and its FMT particle at 2*pos+1. If sf_h
+//     isn't NULL, the sampling fraction histograms are filled too, as extract_sf does with DC
+//     tracks.
+int read_tracks(REC_Particle * rpart, REC_Track * rtrk, REC_Calorimeter * rcal,
+                REC_Cherenkov * rche, REC_Scintillator * rsci, FMT_Tracks * ftrk,
+                std::vector<particle> * trk_p, std::vector<track_info> * trk_info,
+                sf_histos * sf_h, long * sf_nfills) {
+    long first = trk_info->size();
+    int  ntrk  = rtrk->index->size();
+    trk_p   ->resize(2*(first + ntrk));
+    trk_info->resize(first + ntrk);
+    for (int pos = 0; pos < ntrk; ++pos) {
+        int pindex = rtrk->pindex->at(pos); // pindex is always equal to pos!
+        track_info * t = &(trk_info->at(first + pos));
+
+        // Get reconstructed particle from DC and from FMT.
+        trk_p->at(2*(first + pos))   = particle_init(rpart, rtrk, pos);       // DC.
+        trk_p->at(2*(first + pos)+1) = particle_init(rpart, rtrk, ftrk, pos); // FMT.
+
+        // Get deposited energy, per sector too if the sampling fraction is being extracted.
+        double sf_E[SF_NCALS][NSECTORS];
+        for (int ci = 0; ci < SF_NCALS; ++ci) {
+            for (int si = 0; si < NSECTORS; ++si) sf_E[ci][si] = 0;
+        }
+        t->pcal_E = 0; // PCAL total deposited energy.
+        t->ecin_E = 0; // EC inner total deposited energy.
+        t->ecou_E = 0; // EC outer total deposited energy.
+        for (UInt_t i = 0; i < rcal->pindex->size(); ++i) {
+            if (rcal->pindex->at(i) != pindex) continue;
+            int lyr = (int) rcal->layer->at(i);
+
+            int ci;
+            if      (lyr == PCAL_LYR) {t->pcal_E += rcal->energy->at(i); ci = PCAL_IDX;}
+            else if (lyr == ECIN_LYR) {t->ecin_E += rcal->energy->at(i); ci = ECIN_IDX;}
+            else if (lyr == ECOU_LYR) {t->ecou_E += rcal->energy->at(i); ci = ECOU_IDX;}
+            else return 2;
+
+            if (sf_h == NULL) continue;
+            int si = rcal->sector->at(i) - 1;
+            if      (si == -1)                   continue;
+            else if (si < -1 || si > NSECTORS-1) return 9;
+            sf_E[ci][si] += rcal->energy->at(i);
+        }
+        t->tot_E = t->pcal_E + t->ecin_E + t->ecou_E;
+
+        if (sf_h != NULL) {
+            double tot_P = calc_magnitude<double>(rpart->px->at(pindex), rpart->py->at(pindex),
+                                                  rpart->pz->at(pindex));
+            fill_sf_track(sf_h, tot_P, sf_E, sf_nfills);
+        }
+
+        // Get Cherenkov counters data.
+        t->htcc_nphe = 0; // Number of photoelectrons deposited in htcc.
+        t->ltcc_nphe = 0; // Number of photoelectrons deposited in ltcc.
+        for (UInt_t i = 0; i < rche->pindex->size(); ++i) {
+            if (rche->pindex->at(i) == pindex) {
+                int detector = rche->detector->at(i);
+                if      (detector == HTCC_ID) t->htcc_nphe += rche->nphe->at(i);
+                else if (detector == LTCC_ID) t->ltcc_nphe += rche->nphe->at(i);
+                else return 3;
+            }
+        }
+
+        // Get TOF.
+        t->tof = get_tof(* rsci, * rcal, pindex);
+
+        // Get miscellaneous data.
+        t->recon_pid = rpart->pid   ->at(pindex);
+        t->status    = rpart->status->at(pindex);
+        t->sector    = rtrk ->sector->at(pos);
+        t->chi2      = rtrk ->chi2  ->at(pos);
+        t->ndf       = rtrk ->ndf   ->at(pos);
+    }
+
+    return 0;
+}
+
+// Assign PID to the ntrk tracks of event evn and buffer their rows, flushing the buffers once a
+//     full chunk is reached. Returns 12 if the event can't be keyed.
+int write_event(ntuple_writer * w, particle * trk_p, track_info * trk_info, int ntrk,
+                double sf_params[NSECTORS][SF_NPARAMS][2], int run_no, long long evn,
+                double beam_E, float tre_tof) {
+    long long key;
+    if (evn_key(run_no, evn, &key)) return 12;
+
+    // Assign PID to all tracks at once.
+    set_pid_event(trk_p, trk_info, ntrk, sf_params);
+
+    // Check existence of trigger electron
+    particle p_el[2];
+    bool trigger_exist = false;
+    int  trigger_pos   = -1;
+    for (int pos = 0; pos < ntrk; ++pos) {
+        for (int pi = 0; pi < 2; ++pi) p_el[pi] = trk_p[2*pos + pi];
+
+        // Fill TNtuples with trigger electron info
+        for (int pi = 0; pi < 2; ++pi) {
+            if (!(p_el[pi].is_valid&&p_el[pi].is_trigger_electron)) continue;
+            trigger_exist = true;
+            buffer_row(&(w->rows[pi]), &(w->keys[pi]), &(w->batch[pi]), p_el[pi],
+                       dis_kinematics_init(), &(trk_info[pos]), run_no, evn, key, beam_E,
+                       tre_tof);
+        }
+        if (trigger_exist) {
+            trigger_pos = pos;
+            break;
+        }
+    }
+
+    // In case no trigger electron was found, initiate p_el as dummy particles.
+    if (!trigger_exist){
+        p_el[0] = particle_init();
+        p_el[1] = particle_init();
+    }
+
+    // Compute DIS kinematics once per event.
+    dis_kinematics k_el[2];
+    for (int pi = 0; pi < 2; ++pi) k_el[pi] = dis_kinematics_init(p_el[pi], beam_E);
+
+    // Processing particles.
+    for (int pos = 0; pos < ntrk; ++pos) {
+        // Conditional to avoid trigger electron double counting.
+        if (trigger_pos == pos) continue;
+        particle * p = &(trk_p[2*pos]);
+
+        // Test PID assignment precision.
+        int rec_pid = trk_info[pos].recon_pid;
+        if (w->debug && pid_qa_idx(abs(rec_pid)) != -1 && pid_qa_idx(abs(p[0].pid)) != -1) {
+            w->pid_n[pid_qa_idx(abs(rec_pid))]++;
+            w->pid_qa[pid_qa_idx(abs(rec_pid))][pid_qa_idx(abs(p[0].pid))]++;
+        }
+
+        // Fill TNtuples.
+        for (int pi = 0; pi < 2; ++pi) {
+            if (!p[pi].is_valid) continue;
+            buffer_row(&(w->rows[pi]), &(w->keys[pi]), &(w->batch[pi]), p[pi], k_el[pi],
+                       &(trk_info[pos]), run_no, evn, key, beam_E, tre_tof);
+        }
+    }
+
+    // Flush rows once a full chunk is buffered.
+    for (int pi = 0; pi < 2; ++pi) {
+        if (particle_batch_size(&(w->batch[pi])) < PARTICLE_BATCH_CHUNK) continue;
+        w->batch_n += particle_batch_size(&(w->batch[pi]));
+        flush_rows(w->t[pi], &(w->batch[pi]), &(w->rows[pi]), &(w->keys[pi]), &(w->key),
+                   w->debug ? &(w->batch_ns) : NULL);
+    }
+
+    return 0;
+}
+
+// Make the ntuples of in_filename. If fused is true, the sampling fraction is extracted in the same
+//     read instead of being taken from its sf_params file. Tracks are then kept in memory until
+//     the sampling fraction is fitted, and PID is assigned to them afterwards, so the banks are
+//     read only once.
+int run(char * in_filename, bool debug, long nevn, int run_no, double beam_E, bool fused) {
     double sf_params[NSECTORS][SF_NPARAMS][2];
-    if (get_sf_params(Form("../data/sf_params_%06d.txt", run_no), sf_params)) return 8;
+    if (!fused && get_sf_params(Form("../data/sf_params_%06d.txt", run_no), sf_params)) return 8;
 
     char*  out_filename = (char *) malloc(128 * sizeof(char));
     sprintf(out_filename, "../root_io/ntuples.root");
@@ -101,9 +345,15 @@ int run(char * in_filename, bool debug, int nevn, int run_no, double beam_E) {
     // Create TTree and TNTuples.
     TTree   * t_in  = f_in->Get<TTree>("Tree");
     if (t_in==NULL) return 1;
-    TNtuple * t_out[2];
-    t_out[0] = new TNtuple(S_DC,  S_DC,  vars);
-    t_out[1] = new TNtuple(S_FMT, S_FMT, vars);
+    ntuple_writer w;
+    w.t[0]     = new TNtuple(S_DC,  S_DC,  vars);
+    w.t[1]     = new TNtuple(S_FMT, S_FMT, vars);
+    for (int pi = 0; pi < 2; ++pi) w.t[pi]->Branch(R_EVNKEY, &(w.key), R_EVNKEY "/L");
+    w.batch_n  = 0;
+    w.batch_ns = 0;
+    w.debug    = debug;
+    for (int i = 0; i < NPIDS; ++i) w.pid_n[i] = 0;
+    for (int i = 0; i < NPIDS; ++i) for (int j = 0; j < NPIDS; ++j) w.pid_qa[i][j] = 0;
 
     // Associate banks to TTree.
     REC_Particle     rpart(t_in);
@@ -113,23 +363,38 @@ int run(char * in_filename, bool debug, int nevn, int run_no, double beam_E) {
     REC_Scintillator rsci (t_in);
     FMT_Tracks       ftrk (t_in);
 
-    // Counters for fancy progress bar.
-    int divcntr     = 0;
-    int evnsplitter = 0;
+    // Event numbers come from RUN::config, so that keys don't collide between the input files of a
+    //     run. Inputs from older versions of hipo2root lack it, and fall back to the entry number.
+    RUN_Config * rcfg = NULL;
+    if (t_in->GetBranch("RUN::config::event")) rcfg = new RUN_Config(t_in);
+    else printf("%s has no RUN::config bank. Using entry numbers as event numbers, so events are "
+                "only unique within this file.\n", in_filename);
 
-    // Counters for PID assignment quality assessment.
-    int pid_n[NPIDS];
-    int pid_qa[NPIDS][NPIDS];
-    if (debug) {
-        for (int i = 0; i < NPIDS; ++i) pid_n[i] = 0;
-        for (int i = 0; i < NPIDS; ++i) for (int j = 0; j < NPIDS; ++j) pid_qa[i][j] = 0;
+    // Counters for fancy progress bar.
+    int       divcntr     = 0;
+    long long evnsplitter = 0;
+
+    // Sampling fraction histograms, only used in fused mode.
+    sf_histos sf_h;
+    long      sf_nfills = 0;
+    if (fused) {
+        TH1::AddDirectory(kFALSE);
+        book_sf_histos(&sf_h);
     }
 
+    // Particles and detector information of all tracks in an event, reused across events. In
+    //     fused mode, they hold the tracks of all events instead, indexed by cache.
+    std::vector<particle>     trk_p;
+    std::vector<track_info>   trk_info;
+    std::vector<cached_event> cache;
+
     // Iterate through input file. Each TTree entry is one event.
-    printf("Reading %lld events from %s.\n", nevn == -1 ? t_in->GetEntries() : nevn, in_filename);
+    printf("Reading %lld events from %s.\n", nevn == -1 ? t_in->GetEntries() : (long long) nevn,
+           in_filename);
 
     // test of electrons
-    for (int evn = 0; (evn < t_in->GetEntries()) && (nevn == -1 || evn < nevn); ++evn) {
+    long long evn;
+    for (evn = 0; (evn < t_in->GetEntries()) && (nevn == -1 || evn < nevn); ++evn) {
         if (!debug && evn >= evnsplitter) {
             if (evn != 0) {
                 printf("\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b");
@@ -152,182 +417,34 @@ int run(char * in_filename, bool debug, int nevn, int run_no, double beam_E) {
         rcal .get_entries(t_in, evn);
         rche .get_entries(t_in, evn);
         ftrk .get_entries(t_in, evn);
+        if (rcfg) rcfg->get_entries(t_in, evn);
 
         // Filter events without the necessary banks.
         if (rpart.vz->size() == 0 || rtrk.pindex->size() == 0) continue;
+        if (rcfg && rcfg->event->size() == 0) continue;
+        long long evn_no = rcfg ? (long long) rcfg->event->at(0) : evn;
 
         // Find trigger electron's TOF.
         float tre_tof = get_tof(rsci, rcal, rtrk.pindex->at(0));
 
-        // Check existence of trigger electron
-        particle p_el[2];
-        bool    trigger_exist  = false;
-        UInt_t  trigger_pos    = -1;
-        int     trigger_pindex = -1;
-        for (UInt_t pos = 0; pos < rtrk.index->size(); ++pos) { 
-            int pindex = rtrk.pindex->at(pos); // pindex is always equal to pos!
-
-            // Get reconstructed particle from DC and from FMT.
-            p_el[0] = particle_init(&rpart, &rtrk, pos);        // DC.
-            p_el[1] = particle_init(&rpart, &rtrk, &ftrk, pos); // FMT.
-
-            // Get deposited energy.
-            float pcal_E = 0; // PCAL total deposited energy.
-            float ecin_E = 0; // EC inner total deposited energy.
-            float ecou_E = 0; // EC outer total deposited energy.
-            for (UInt_t i = 0; i < rcal.pindex->size(); ++i) {
-                if (rcal.pindex->at(i) != pindex) continue;
-                int lyr = (int) rcal.layer->at(i);
-
-                if      (lyr == PCAL_LYR) pcal_E += rcal.energy->at(i);
-                else if (lyr == ECIN_LYR) ecin_E += rcal.energy->at(i);
-                else if (lyr == ECOU_LYR) ecou_E += rcal.energy->at(i);
-                else return 2;
-            }
-            float tot_E = pcal_E + ecin_E + ecou_E;
-
-            // Get Cherenkov counters data.
-            int htcc_nphe = 0; // Number of photoelectrons deposited in htcc.
-            int ltcc_nphe = 0; // Number of photoelectrons deposited in ltcc.
-            for (UInt_t i = 0; i < rche.pindex->size(); ++i) {
-                if (rche.pindex->at(i) == pindex) {
-                    int detector = rche.detector->at(i);
-                    if      (detector == HTCC_ID) htcc_nphe += rche.nphe->at(i);
-                    else if (detector == LTCC_ID) ltcc_nphe += rche.nphe->at(i);
-                    else return 3;
-                }
-            }
-
-            // Get TOF.
-            float tof = get_tof(rsci, rcal, pindex);
-
-            // Get miscellaneous data.
-            int status = rpart.status->at(pindex);
-            float chi2 = rtrk.chi2   ->at(pos);
-            float ndf  = rtrk.ndf    ->at(pos);
-            
-            int rec_pid     = rpart.pid->at(pindex);
-            int rec_pid_fmt = rpart.pid->at(pindex);
-            // Assign PID.
-            for (int pi = 0; pi < 2; ++pi) {
-                set_pid(&(p_el[pi]), rpart.pid->at(pindex), status, tot_E, pcal_E, htcc_nphe,
-                        ltcc_nphe, sf_params[rtrk.sector->at(pos)]);
-            }
-            
-            // Fill TNtuples with trigger electron info
-            for (int pi = 0; pi < 2; ++pi) {
-                if (!(p_el[pi].is_valid&&p_el[pi].is_trigger_electron)) continue;
-                trigger_exist = true;
-                Float_t v[VAR_LIST_SIZE] = {
-                        (Float_t) run_no, (Float_t) evn, (Float_t) beam_E,
-                        (Float_t) p_el[pi].pid, (Float_t) status, (Float_t) p_el[pi].q, p_el[pi].mass,
-                        p_el[pi].vx, p_el[pi].vy, p_el[pi].vz, p_el[pi].px, p_el[pi].py, p_el[pi].pz,
-                        P(p_el[pi]), theta_lab(p_el[pi]), phi_lab(p_el[pi]), p_el[pi].beta,
-                        chi2, ndf,
-                        pcal_E, ecin_E, ecou_E, tot_E,
-                        (tof - tre_tof),
-                        Q2(p_el[pi], beam_E), nu(p_el[pi], beam_E),
-                        Xb(p_el[pi], beam_E), W2(p_el[pi], beam_E),
-                        0, 0, 0,
-                        0, 0
-                };
-                t_out[pi]->Fill(v);
-            }
-            if (trigger_exist){
-                trigger_pindex = pindex;
-                trigger_pos    = pos;
-                break;
-            }
-        }
-
-        // In case no trigger electron was found, initiate p_el as dummy particles.
-        if (!trigger_exist){
-            p_el[0] = particle_init();
-            p_el[1] = particle_init();
+        // Get particles and detector information from all tracks.
+        if (!fused) {
+            trk_p   .clear();
+            trk_info.clear();
         }
-
-        // Processing particles.
-        for (UInt_t pos = 0; pos < rtrk.index->size(); ++pos) { 
-            int pindex = rtrk.pindex->at(pos); // pindex is always equal to pos!
-            
-            // Conditional to avoid trigger electron double counting.
-            if (trigger_pindex==pindex&&trigger_pos==pos) continue;
-
-            // Get reconstructed particle from DC and from FMT.
-            particle p[2];
-            p[0] = particle_init(&rpart, &rtrk, pos);        // DC.
-            p[1] = particle_init(&rpart, &rtrk, &ftrk, pos); // FMT.
-
-            // Get deposited energy.
-            float pcal_E = 0; // PCAL total deposited energy.
-            float ecin_E = 0; // EC inner total deposited energy.
-            float ecou_E = 0; // EC outer total deposited energy.
-            for (UInt_t i = 0; i < rcal.pindex->size(); ++i) {
-                if (rcal.pindex->at(i) != pindex) continue;
-                int lyr = (int) rcal.layer->at(i);
-
-                if      (lyr == PCAL_LYR) pcal_E += rcal.energy->at(i);
-                else if (lyr == ECIN_LYR) ecin_E += rcal.energy->at(i);
-                else if (lyr == ECOU_LYR) ecou_E += rcal.energy->at(i);
-                else return 2;
-            }
-            float tot_E = pcal_E + ecin_E + ecou_E;
-
-            // Get Cherenkov counters data.
-            int htcc_nphe = 0; // Number of photoelectrons deposited in htcc.
-            int ltcc_nphe = 0; // Number of photoelectrons deposited in ltcc.
-            for (UInt_t i = 0; i < rche.pindex->size(); ++i) {
-                if (rche.pindex->at(i) == pindex) {
-                    int detector = rche.detector->at(i);
-                    if      (detector == HTCC_ID) htcc_nphe += rche.nphe->at(i);
-                    else if (detector == LTCC_ID) ltcc_nphe += rche.nphe->at(i);
-                    else return 3;
-                }
-            }
-
-            // Get TOF.
-            float tof = get_tof(rsci, rcal, pindex);
-
-            // Get miscellaneous data.
-            int status = rpart.status->at(pindex);
-            float chi2 = rtrk.chi2   ->at(pos);
-            float ndf  = rtrk.ndf    ->at(pos);
-            
-            // Assign PID.
-            for (int pi = 0; pi < 2; ++pi) {
-                set_pid(&(p[pi]), rpart.pid->at(pindex), status, tot_E, pcal_E, htcc_nphe,
-                        ltcc_nphe, sf_params[rtrk.sector->at(pos)]);
-            }
-
-            // Test PID assignment precision.
-            if (debug
-                    && PID_QA.find(abs(rpart.pid->at(pindex))) != PID_QA.end()
-                    && PID_QA.find(abs(p[0].pid)) != PID_QA.end()) {
-                pid_n[PID_QA.at(abs(rpart.pid->at(pindex)))]++;
-                pid_qa[PID_QA.at(abs(rpart.pid->at(pindex)))][PID_QA.at(abs(p[0].pid))]++;
-            }
-
-            // Fill TNtuples. TODO. This probably should be implemented more elegantly.
-            // NOTE. If adding new variables, check their order in S_VAR_LIST.
-            for (int pi = 0; pi < 2; ++pi) {
-                if (!p[pi].is_valid) continue;
-                Float_t v[VAR_LIST_SIZE] = {
-                        (Float_t) run_no, (Float_t) evn, (Float_t) beam_E,
-                        (Float_t) p[pi].pid, (Float_t) status, (Float_t) p[pi].q, p[pi].mass,
-                        p[pi].vx, p[pi].vy, p[pi].vz, p[pi].px, p[pi].py, p[pi].pz,
-                        P(p[pi]), theta_lab(p[pi]), phi_lab(p[pi]), p[pi].beta,
-                        chi2, ndf,
-                        pcal_E, ecin_E, ecou_E, tot_E,
-                        (tof - tre_tof),
-                        Q2(p[pi], beam_E), nu(p[pi], beam_E),
-                        Xb(p[pi], beam_E), W2(p[pi], beam_E),
-                        zh(p[pi],p_el[pi], beam_E), Pt2(p[pi],p_el[pi], beam_E), Pl2(p[pi],p_el[pi], beam_E),
-                        phi_pq(p[pi],p_el[pi], beam_E), theta_pq(p[pi],p_el[pi], beam_E)
-                };
-                
-                t_out[pi]->Fill(v);
-            }
+        long first = trk_info.size();
+        int  chk   = read_tracks(&rpart, &rtrk, &rcal, &rche, &rsci, &ftrk, &trk_p, &trk_info,
+                                 fused ? &sf_h : NULL, &sf_nfills);
+        if (chk) return chk;
+        int ntrk = trk_info.size() - first;
+
+        if (fused) {
+            cache.push_back({evn_no, tre_tof, first, ntrk});
+            continue;
         }
+        chk = write_event(&w, trk_p.data(), trk_info.data(), ntrk, sf_params, run_no, evn_no,
+                          beam_E, tre_tof);
+        if (chk) return chk;
     }
     if (!debug) {
         printf("\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b");
@@ -335,6 +452,33 @@ int run(char * in_filename, bool debug, int nevn, int run_no, double beam_E) {
         printf("[==================================================] 100%% \n");
     }
 
+    // Fit the sampling fraction and assign PID to the cached tracks. Parameters are read back from
+    //     the sf_params file, so that PID is the same as when running extract_sf first.
+    if (fused) {
+        printf("Cached %ld tracks from %ld events (%.1f MB). Filled %ld SF entries.\n",
+               (long) trk_info.size(), (long) cache.size(),
+               (trk_p.size()*sizeof(particle) + trk_info.size()*sizeof(track_info)
+                + cache.size()*sizeof(cached_event)) / 1e6, sf_nfills);
+        char state_filename[128];
+        snprintf(state_filename, sizeof(state_filename), "../root_io/sf_state_%06d.root", run_no);
+        if (write_sf_state(&sf_h, state_filename, run_no, false, evn)) return 11;
+        if (fit_and_save_sf(&sf_h, run_no, false, false, 1, NULL)) return 10;
+        free_sf_histos(&sf_h);
+        if (get_sf_params(Form("../data/sf_params_%06d.txt", run_no), sf_params)) return 8;
+
+        for (UInt_t ei = 0; ei < cache.size(); ++ei) {
+            cached_event * e = &(cache[ei]);
+            int chk = write_event(&w, &(trk_p[2*e->first]), &(trk_info[e->first]), e->ntrk,
+                                  sf_params, run_no, e->evn, beam_E, e->tre_tof);
+            if (chk) return chk;
+        }
+    }
+    for (int pi = 0; pi < 2; ++pi) {
+        w.batch_n += particle_batch_size(&(w.batch[pi]));
+        flush_rows(w.t[pi], &(w.batch[pi]), &(w.rows[pi]), &(w.keys[pi]), &(w.key),
+                   w.debug ? &(w.batch_ns) : NULL);
+    }
+
     if (debug) {
         printf("\nparticle identification matrix:\n        e     pi    K     p     n     gamma\n");
         for (int i = 0; i < NPIDS; ++i) {
@@ -345,19 +489,22 @@ int run(char * in_filename, bool debug, int nevn, int run_no, double beam_E) {
             if (i == 4) printf("    n  ");
             if (i == 5) printf("gamma  ");
             for (int j = 0; j < NPIDS; ++j) {
-                printf("%5.2f ", ((double) pid_qa[j][i])/((double) pid_n[j]));
+                printf("%5.2f ", ((double) w.pid_qa[j][i])/((double) w.pid_n[j]));
             }
             printf("\n");
         }
         printf("\n");
+        printf("Particle kinematics: %ld particles, %.1f ns per particle.\n\n", w.batch_n,
+               w.batch_n > 0 ? w.batch_ns/w.batch_n : 0.);
     }
 
     // Write to output file.
     f_out->cd();
-    t_out[0]->Write();
-    t_out[1]->Write();
+    w.t[0]->Write();
+    w.t[1]->Write();
 
     // Clean up after ourselves.
+    delete rcfg;
     f_in ->Close();
     f_out->Close();
     free(in_filename);
@@ -368,14 +515,15 @@ int run(char * in_filename, bool debug, int nevn, int run_no, double beam_E) {
 // Call program from terminal, C-style.
 int main(int argc, char ** argv) {
     bool debug         = false;
-    int nevn           = -1;
+    long nevn          = -1;
     int run_no         = -1;
     double beam_E      = -1;
     char * in_filename = NULL;
+    bool fused         = false;
 
     if (make_ntuples_handle_args_err(make_ntuples_handle_args(argc, argv, &debug, &nevn,
-            &in_filename, &run_no, &beam_E), &in_filename, run_no))
+            &in_filename, &run_no, &beam_E, &fused), &in_filename, run_no))
         return 1;
 
-    return make_ntuples_err(run(in_filename, debug, nevn, run_no, beam_E), &in_filename);
+    return make_ntuples_err(run(in_filename, debug, nevn, run_no, beam_E, fused), &in_filename);
 }
@@ -0,0 +1,106 @@
+// CLAS12 RG-E Analyser.
+// Copyright (C) 2022 Bruno Benkel
+//
+// This program is free software: you can redistribute it and/or modify it under the terms of the
+// GNU Lesser General Public License as published by the Free Software Foundation, either version 3
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+// even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// Lesser General Public License for more details.
+//
+// You can see a copy of the GNU Lesser Public License under the LICENSE file.
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <TH1.h>
+#include <TROOT.h>
+
+#include "../lib/constants.h"
+#include "../lib/err_handler.h"
+#include "../lib/io_handler.h"
+#include "../lib/sf_fits.h"
+
+// Merge sampling fraction state files written by extract_sf or by a previous merge_sf, and fit the
+//     merged histograms. No event data is read, so adding a file to a run's calibration only costs
+//     running extract_sf over that file.
+
+int run(char **in_files, int nfiles, int *bad_file, char *out_file, char *seed_file, int nthreads,
+        bool fast_fit, bool cmp_fits) {
+    TH1::AddDirectory(kFALSE);
+    if (nthreads > 1) ROOT::EnableThreadSafety();
+
+    // Get fit seeds.
+    sf_seeds  seeds_buf;
+    sf_seeds *seeds = NULL;
+    if (seed_file != NULL) {
+        if (get_sf_seeds(&seeds_buf, seed_file)) return 7;
+        seeds = &seeds_buf;
+    }
+
+    sf_histos h;
+    book_sf_histos(&h);
+
+    // Add all state files, checking that they're from the same run and used the same tracker.
+    int  run_no  = -1;
+    bool use_fmt = false;
+    long nevents = 0;
+    for (int fi = 0; fi < nfiles; ++fi) {
+        * bad_file = fi;
+        int  f_run_no  = -1;
+        bool f_use_fmt = false;
+        long f_nevents = 0;
+        int chk = read_sf_state(&h, in_files[fi], &f_run_no, &f_use_fmt, &f_nevents);
+        if (chk) return chk;
+
+        if (fi == 0) {
+            run_no  = f_run_no;
+            use_fmt = f_use_fmt;
+        }
+        else if (f_run_no  != run_no)  return 3;
+        else if (f_use_fmt != use_fmt) return 6;
+
+        nevents += f_nevents;
+        printf("Added %ld events from %s.\n", f_nevents, in_files[fi]);
+    }
+    printf("Merged %ld events from %d files of run %d.\n", nevents, nfiles, run_no);
+
+    // Save merged state so that more files can be added to it later.
+    if (out_file != NULL) {
+        if (write_sf_state(&h, out_file, run_no, use_fmt, nevents)) return 5;
+        printf("Saved merged histograms to %s.\n", out_file);
+    }
+
+    // Fit histograms and save results.
+    if (fit_and_save_sf(&h, run_no, fast_fit, cmp_fits, nthreads, seeds)) return 4;
+
+    return 0;
+}
+
+// Call program from terminal, C-style.
+int main(int argc, char **argv) {
+    int nthreads    = 1;
+    bool fast_fit   = false;
+    bool cmp_fits   = false;
+    char *out_file  = NULL;
+    char *seed_file = NULL;
+    char **in_files = NULL;
+    int nfiles      = 0;
+
+    if (merge_sf_handle_args_err(merge_sf_handle_args(argc, argv, &nthreads, &fast_fit, &cmp_fits,
+            &out_file, &seed_file, &in_files, &nfiles), in_files, nfiles, &out_file, &seed_file))
+        return 1;
+
+    int bad_file = -1;
+    int errcode  = run(in_files, nfiles, &bad_file, out_file, seed_file, nthreads, fast_fit,
+                       cmp_fits);
+    if (errcode) return merge_sf_err(errcode, in_files, nfiles, bad_file, &out_file, &seed_file);
+
+    for (int fi = 0; fi < nfiles; ++fi) free(in_files[fi]);
+    free(in_files);
+    free(out_file);
+    free(seed_file);
+    return 0;
+}
@@ -17,6 +17,33 @@ const int PID_POSITIVE[PID_POSITIVE_SIZE] = {-11,  211,  321,  2212, 45};
 const int PID_NEGATIVE[PID_NEGATIVE_SIZE] = { 11, -211, -321, -2212};
 const int PID_NEUTRAL [PID_NEUTRAL_SIZE]  = { 22, 2112};
 
+// Hypotheses lists, indexed by charge + 1.
+const int * PID_HYPOTHESES[3] = {PID_NEGATIVE, PID_NEUTRAL, PID_POSITIVE};
+const int PID_HYPOTHESES_SIZE[3] = {PID_NEGATIVE_SIZE, PID_NEUTRAL_SIZE, PID_POSITIVE_SIZE};
+
+// PID decision table, indexed by charge + 1, electron check, and pion check (HTCC signal and
+//     momentum over threshold). Each row gives the index in the hypotheses list of the assigned PID,
+//     as a function of the index of the reconstruction PID in that same list (last column if it's
+//     not in the list). -1 means that no PID was assigned. Hypotheses are checked in order:
+//     * e-/e+ are accepted if they match recon or pass the electron check.
+//     * pions are accepted if they match recon or pass the pion check without passing the electron
+//       check.
+//     * all other particles are accepted if they match recon.
+constexpr int PID_DECISION[3][2][2][PID_HYPOTHESES_MAX+1] = {
+        { // Negative.
+            {{ 0,  1,  2,  3, -1, -1}, { 0,  1,  1,  1, -1,  1}},
+            {{ 0,  0,  0,  0, -1,  0}, { 0,  0,  0,  0, -1,  0}},
+        },
+        { // Neutral.
+            {{ 0,  1, -1, -1, -1, -1}, { 0,  1, -1, -1, -1, -1}},
+            {{ 0,  1, -1, -1, -1, -1}, { 0,  1, -1, -1, -1, -1}},
+        },
+        { // Positive.
+            {{ 0,  1,  2,  3,  4, -1}, { 0,  1,  1,  1,  1,  1}},
+            {{ 0,  0,  0,  0,  0,  0}, { 0,  0,  0,  0,  0,  0}},
+        },
+};
+
 // TODO. Essentially all methods in this file require testing. Get to that.
 
 // Initialize an empty particle.
@@ -74,71 +101,72 @@ particle particle_init(int charge, double beta, int sector,
     p.py = py;
     p.pz = pz;
 
-    // NOTE. If programs gets slow, I should cache values of Q2, nu, etc here.
     return p;
 }
 
-// Set PID from all available information. This function mimics PIDMatch from the EB engine.
-int set_pid(particle * p, int recon_pid, int status, double tot_E, double pcal_E, int htcc_nphe,
-            int ltcc_nphe, double sf_params[SF_NPARAMS][2]) {
-    // Assign PID for neutrals and store PID from reconstruction for charge particles.
-    int rpid = p->q == 0 ? assign_neutral_pid(tot_E, p->beta) : recon_pid;
-    
-    // Create PID list.
-    int hypotheses_size;
-    if      (p->q >  0) hypotheses_size = PID_POSITIVE_SIZE;
-    else if (p->q == 0) hypotheses_size = PID_NEUTRAL_SIZE;
-    else                hypotheses_size = PID_NEGATIVE_SIZE;
-
-    int hypotheses[hypotheses_size];
-    for (int pi = 0; p->q >  0 && pi < hypotheses_size; ++pi) hypotheses[pi] = PID_POSITIVE[pi];
-    for (int pi = 0; p->q == 0 && pi < hypotheses_size; ++pi) hypotheses[pi] = PID_NEUTRAL [pi];
-    for (int pi = 0; p->q <  0 && pi < hypotheses_size; ++pi) hypotheses[pi] = PID_NEGATIVE[pi];
-
-    // Perform checks.
-    bool e_check = is_electron(tot_E, pcal_E, htcc_nphe, P(*p), sf_params);
-
-    bool htcc_signal_check = htcc_nphe > HTCC_NPHE_CUT;
-    bool htcc_pion_threshold = P(*p) > HTCC_PION_THRESHOLD;
-
-    // NOTE. LTCC signals are used in recon to veto back from kaon and proton to pion, but we don't
-    //       do that here since we're using the PID from reconstrution anyway.
-    // bool ltcc_signal_check = ltcc_nphe > LTCC_NPHE_CUT;
-    // bool ltcc_pion_threshold = P(*p) > LTCC_PION_THRESHOLD;
-
-    // NOTE. LTCC kaon threshold is defined in reconstruction, but never actually used.
-    // bool ltcc_kaon_threshold = P(*p) > LTCC_KAON_THRESHOLD;
-
-    // Match PID.
-    for (int pi = 0; p->pid == 0 && pi < hypotheses_size; ++pi) {
-        p->pid = match_pid(hypotheses[pi], hypotheses[pi] == rpid, p->q, e_check, htcc_signal_check,
-                           htcc_pion_threshold);
-    }
+// Set PID for all tracks in an event. This function mimics PIDMatch from the EB engine. `p` holds
+//     two particles per track, reconstructed from DC and FMT respectively, and `info` holds each
+//     track's detector information. Checks that don't depend on the tracker are done once per track.
+int set_pid_event(particle p[], track_info info[], int ntracks,
+                  double sf_params[NSECTORS][SF_NPARAMS][2]) {
+    for (int ti = 0; ti < ntracks; ++ti) {
+        track_info * t = &(info[ti]);
+        particle * p_trk = &(p[2*ti]); // DC particle is always valid, so we take q and beta from it.
 
-    // Check if particle is trigger electron and define mass from PID.
-    p->is_trigger_electron = (p->pid == 11 && status < 0);
-    p->mass = MASS.at(abs(p->pid));
-    // If not lepton check if its valid hadron.
-    if (p->pid>=100||p->pid<=100)
-        p->is_hadron = true;
+        // Assign PID for neutrals and store PID from reconstruction for charge particles.
+        int qi   = p_trk[0].q > 0 ? 2 : (p_trk[0].q == 0 ? 1 : 0);
+        int rpid = qi == 1 ? assign_neutral_pid(t->tot_E, p_trk[0].beta) : t->recon_pid;
 
-    return 0;
-}
+        // Find reconstruction PID in hypotheses list.
+        int rpos = PID_HYPOTHESES_MAX;
+        for (int hi = 0; hi < PID_HYPOTHESES_SIZE[qi]; ++hi) {
+            if (PID_HYPOTHESES[qi][hi] == rpid) rpos = hi;
+        }
+
+        // Electron checks. Require ECAL, HTCC photoelectrons, and PCAL.
+        bool e_detectors = !(t->tot_E < 1e-9) && !(t->htcc_nphe < HTCC_NPHE_CUT)
+                && !(t->pcal_E < MIN_PCAL_ENERGY);
+
+        // ECAL sampling fraction bounds.
+        double mean  = 0;
+        double sigma = 0;
+        if (e_detectors) {
+            double (* pars)[2] = sf_params[t->sector];
+            double tot_E = t->tot_E;
+            mean  = pars[0][0]*(pars[1][0] + pars[2][0]/tot_E + pars[3][0]/(tot_E*tot_E));
+            sigma = pars[0][1]*(pars[1][1] + pars[2][1]/tot_E + pars[3][1]/(tot_E*tot_E));
+        }
 
-// Check if a particle satisfies all requirements to be considered an electron or positron.
-bool is_electron(double tot_E, double pcal_E, double htcc_nphe, double p,
-                 double pars[SF_NPARAMS][2]) {
-    if (tot_E < 1e-9)              return false; // Require ECAL.
-    if (p < 1e-9)                  return false; // Momentum must be greater than 0.
-    if (htcc_nphe < HTCC_NPHE_CUT) return false; // Require HTCC photoelectrons.
-    if (pcal_E < MIN_PCAL_ENERGY)  return false; // Require PCAL.
+        bool htcc_signal_check = t->htcc_nphe > HTCC_NPHE_CUT;
 
-    // Require ECAL sampling fraction to be below threshold.
-    double mean  = pars[0][0]*(pars[1][0] + pars[2][0]/tot_E + pars[3][0]/(tot_E*tot_E));
-    double sigma = pars[0][1]*(pars[1][1] + pars[2][1]/tot_E + pars[3][1]/(tot_E*tot_E));
-    if (abs((tot_E/p - mean)/sigma) > E_SF_NSIGMA) return false;
+        // NOTE. LTCC signals are used in recon to veto back from kaon and proton to pion, but we
+        //       don't do that here since we're using the PID from reconstrution anyway. The LTCC
+        //       kaon threshold is defined in reconstruction, but never actually used.
+
+        for (int pi = 0; pi < 2; ++pi) {
+            particle * pp = &(p_trk[pi]);
+            if (!pp->is_valid) continue;
+            double mom = P(*pp);
+
+            // Momentum must be greater than 0 and sampling fraction must be within bounds.
+            bool e_check = e_detectors && !(mom < 1e-9)
+                    && !(abs((t->tot_E/mom - mean)/sigma) > E_SF_NSIGMA);
+            bool pion_check = htcc_signal_check && mom > HTCC_PION_THRESHOLD;
+
+            // Match PID.
+            int hi  = PID_DECISION[qi][e_check][pion_check][rpos];
+            pp->pid = hi == -1 ? 0 : PID_HYPOTHESES[qi][hi];
+
+            // Check if particle is trigger electron and define mass from PID.
+            pp->is_trigger_electron = (pp->pid == 11 && t->status < 0);
+            pp->mass = pid_mass(abs(pp->pid));
+            // If not lepton check if its valid hadron.
+            if (pp->pid>=100||pp->pid<=100)
+                pp->is_hadron = true;
+        }
+    }
 
-    return true;
+    return 0;
 }
 
 int assign_neutral_pid(double tot_E, double beta) {
@@ -151,7 +179,7 @@ int best_pid_from_momentum(double p, double beta, int hypotheses[], int hypothes
     double min_diff = DBL_MAX;
     for (int pi = 0; pi < hypotheses_size; ++pi) {
         if (abs(hypotheses[pi]) == 45 || hypotheses[pi] == 0 || abs(hypotheses[pi]) == 11) continue;
-        double mass = MASS.at(abs(hypotheses[pi]));
+        double mass = pid_mass(abs(hypotheses[pi]));
         double p_beta = p/(sqrt(mass*mass + p*p));
         double diff = abs(p_beta - beta);
         if (diff < min_diff) {
@@ -162,22 +190,6 @@ int best_pid_from_momentum(double p, double beta, int hypotheses[], int hypothes
     return min_pid;
 }
 
-// Match PID hypothesis with available checks.
-int match_pid(int hyp, bool r_match, int q, bool e, bool htcc_s, bool htcc_p) {
-    switch(abs(hyp)) {
-        case 11:
-            if (r_match || e) return hyp;
-            break;
-        case 211:
-            if (r_match || (!e && (htcc_s && htcc_p))) return hyp;
-            break;
-        case 321: case 2212: case 45: case 2112: case 22:
-            if (r_match) return hyp;
-            break;
-    }
-    return 0;
-}
-
 // === PARTICLE FUNCTIONS ==========================================================================
 // Get distance from beamline.
 float d_from_beamline(particle p) {
@@ -186,17 +198,17 @@ float d_from_beamline(particle p) {
 
 // Calculate theta angle in the lab frame from momentum components of particle.
 float theta_lab(particle p) {
-    return p.px == 0.0 && p.py == 0.0 && p.pz == 0.0 ? 0.0 : atan2(sqrt(p.px*p.px + p.py*p.py), p.pz);
+    return calc_theta_lab<double>(p.px, p.py, p.pz);
 }
 
 // Calculate phi angle in the lab frame from momentum components of particle.
 float phi_lab(particle p) {
-    return atan2(p.py, p.px);
+    return calc_phi_lab<double>(p.px, p.py);
 }
 
 // Calculate momentum magnitude from its components.
 float P(particle p) {
-    return calc_magnitude(p.px, p.py, p.pz);
+    return calc_magnitude<double>(p.px, p.py, p.pz);
 }
 
 // Calculate squared mass from momentum and beta.
@@ -208,19 +220,19 @@ float mass2(particle p) {
 // Calculate nu from beam energy and total momentum.
 float nu(particle p, double bE) {
     if (!p.is_trigger_electron) return 0; // TODO. I need an invalid return value, not zero!
-    return bE - P(p);
+    return calc_nu<double>(bE, P(p));
 }
 
 // Calculate Q^2 from beam energy, particle momentum, and theta angle.
 float Q2(particle p, double bE) {
     if (!p.is_trigger_electron) return 0;
-    return 4 * bE * P(p) * pow(sin(theta_lab(p)/2), 2);
+    return calc_Q2<double>(bE, P(p), theta_lab(p));
 }
 
 // Calculate x_bjorken from beam energy, particle momentum, and theta angle.
 float Xb(particle p, double bE) {
     if (!p.is_trigger_electron) return 0;
-    return Q2(p, bE) / (2*MASS.at(2212)*nu(p, bE));
+    return calc_Xb<double>(Q2(p, bE), nu(p, bE));
 }
 
 // Calculate y_bjorken from beam energy and nu.
@@ -240,7 +252,7 @@ float W(particle p, double bE) {
 // Calculate the squared invariant mass of the electron-nucleon interaction.
 float W2(particle p, double bE) {
     if (!p.is_trigger_electron) return 0;
-    return MASS.at(2212)*MASS.at(2212) + 2*MASS.at(2212)*nu(p, bE) - Q2(p, bE);
+    return calc_W2<double>(Q2(p, bE), nu(p, bE));
 }
 
 // NOTE. double s(particle p) ?
@@ -257,106 +269,230 @@ float phi_photon_lab(particle p) {
     return M_PI + phi_lab(p);
 }
 
+// Initialize an empty set of DIS kinematics.
+dis_kinematics dis_kinematics_init() {
+    dis_kinematics k;
+    k.is_valid = false;
+
+    return k;
+}
+
+// Compute the DIS kinematics of an event from its trigger electron. All SIDIS functions below read
+//     from this, so the electron-dependent values are computed only once per event.
+dis_kinematics dis_kinematics_init(particle e, double bE) {
+    if (!e.is_trigger_electron) return dis_kinematics_init();
+    dis_kinematics k;
+    k.is_valid = true;
+
+    k.nu = nu(e, bE);
+    k.Q2 = Q2(e, bE);
+    k.Xb = Xb(e, bE);
+    k.W2 = W2(e, bE);
+    k.W  = sqrt(abs(k.W2));
+
+    // Virtual photon momentum. Its magnitude is equal to sqrt(Q2 + nu^2).
+    k.qx = -e.px;
+    k.qy = -e.py;
+    k.qz = bE - e.pz;
+    k.q  = calc_magnitude(k.qx, k.qy, k.qz);
+
+    // Rotation to the virtual photon frame.
+    calc_photon_rotation(k.qx, k.qy, k.qz, &k.cos_phi_z, &k.sin_phi_z, &k.cos_phi_y, &k.sin_phi_y);
+
+    return k;
+}
+
 // === SIDIS PRODUCED PARTICLE FUNCTIONS ===========================================================
 // TODO. Many of the methods hereafter assume the particle is a pion. This probably needs to be
 //       fixed for CLAS12.
 
 // Compute the polar angle of a produced particle p with respect to the virtual photon direction.
-// `p` is the produced particle while `e` is the trigger electron.
-
-float theta_pq(particle p, particle e, double bE) {
-    if (!(p.is_hadron&&e.is_trigger_electron)) return 0;
-    return calc_angle(-e.px, -e.py, bE-e.pz, p.px, p.py, p.pz);
+// `p` is the produced particle while `k` holds the event's DIS kinematics.
+float theta_pq(particle p, dis_kinematics k) {
+    if (!(p.is_hadron && k.is_valid)) return 0;
+    double pl = calc_Pl<double>(p.px, p.py, p.pz, k.qx, k.qy, k.qz, k.q);
+    return calc_theta_pq<double>(calc_Pt2<double>(p.px, p.py, p.pz, pl), pl);
 }
 
 // Compute the azimuthal angle of a produced particle p with respect to the virtual photon direction.
-float phi_pq(particle p, particle e, double bE) {
-    if (!(p.is_hadron&&e.is_trigger_electron)) return 0;
-
-    double gpx = -e.px, gpy = -e.py, gpz = bE-e.pz;
-    double ppx = p.px,  ppy = p.py,  ppz = p.pz;
-
-    // Analyser uses gp isntead of p, i.e., the momentum of virtual photon
-    double phi_z = M_PI - atan2(gpy, gpx);
-    
-    rotate_z(&gpx, &gpy, phi_z);
-    rotate_z(&ppx, &ppy, phi_z);
-
-    double phi_y = calc_angle(gpx, gpy, gpz, 0, 0, 1);
-    
-    rotate_y(&ppx, &ppz, phi_y);
-
-    return atan2(ppy, ppx);
+float phi_pq(particle p, dis_kinematics k) {
+    if (!(p.is_hadron && k.is_valid)) return 0;
+    return calc_phi_pq<double>(p.px, p.py, p.pz, k.cos_phi_z, k.sin_phi_z, k.cos_phi_y,
+                               k.sin_phi_y);
 }
 
 // Compute the cosine of the polar angle with respect to the virtual photon direction.
-float cos_theta_pq(particle p, particle e, double bE) {
-    if (!(p.is_hadron&&e.is_trigger_electron)) return 0;
-    return (p.pz*(bE-e.pz) - p.px*e.px - p.py*e.py) / (sqrt(nu(e,bE)*nu(e,bE) + Q2(e,bE)) * P(p));
+float cos_theta_pq(particle p, dis_kinematics k) {
+    if (!(p.is_hadron && k.is_valid)) return 0;
+    return calc_Pl<double>(p.px, p.py, p.pz, k.qx, k.qy, k.qz, k.q) / P(p);
 }
 
 // Return the squared momentum transverse to the virtual photon.
-float Pt2(particle p, particle e, double bE) {
-    if (!(p.is_hadron&&e.is_trigger_electron)) return 0;
-    return P(p) * P(p) * (1 - cos_theta_pq(p,e,bE)*cos_theta_pq(p,e,bE));
+float Pt2(particle p, dis_kinematics k) {
+    if (!(p.is_hadron && k.is_valid)) return 0;
+    double pl = calc_Pl<double>(p.px, p.py, p.pz, k.qx, k.qy, k.qz, k.q);
+    return calc_Pt2<double>(p.px, p.py, p.pz, pl);
 }
 
 // Return the squared momentum longitudinal to the virtual photon.
-float Pl2(particle p, particle e, double bE) {
-    if (!(p.is_hadron&&e.is_trigger_electron)) return 0;
-    return P(p) * P(p) * cos_theta_pq(p,e,bE) * cos_theta_pq(p,e,bE);
+float Pl2(particle p, dis_kinematics k) {
+    if (!(p.is_hadron && k.is_valid)) return 0;
+    double pl = calc_Pl<double>(p.px, p.py, p.pz, k.qx, k.qy, k.qz, k.q);
+    return pl*pl;
 }
 
 // Obtain the fraction of the virtual photon energy taken by the produced particle in the lab frame.
-float zh(particle p, particle e, double bE) {
-    if (!(p.is_hadron&&e.is_trigger_electron)) return 0;
-    return sqrt(p.mass*p.mass + P(p)*P(p)) / nu(e,bE);
+float zh(particle p, dis_kinematics k) {
+    if (!(p.is_hadron && k.is_valid)) return 0;
+    return calc_zh<double>(p.px, p.py, p.pz, p.mass, k.nu);
 }
 
 // Return the longitudinal momentum in the center of mass frame.
-float PlCM(particle p, particle e, double bE) {
-    if (!(p.is_hadron&&e.is_trigger_electron)) return 0;
-    return (nu(e,bE) + MASS.at(2212)) * (sqrt(Pl2(p,e,bE)) - sqrt(Q2(e,bE) + nu(e,bE)*nu(e,bE))
-            * zh(p,e,bE)*nu(e,bE) / (nu(e,bE) + MASS.at(2212))) / W(e,bE);
+float PlCM(particle p, dis_kinematics k) {
+    if (!(p.is_hadron && k.is_valid)) return 0;
+    double m_p = pid_mass(2212);
+    return (k.nu + m_p) * (sqrt(Pl2(p, k)) - k.q * zh(p, k)*k.nu / (k.nu + m_p)) / k.W;
 }
 
 // Obtain the maximum possible value that the momentum could've had in the center of mass frame.
-float PmaxCM(particle p, particle e, double bE) {
-    if (!(p.is_hadron&&e.is_trigger_electron)) return 0;
-    return sqrt(pow(W(e,bE)*W(e,bE) - MASS.at(2112)*MASS.at(2112) + MASS.at(211)*MASS.at(211), 2)
-            - 4*MASS.at(211)*MASS.at(211)*W(e,bE)*W(e,bE)) / (2*W(e,bE));
+float PmaxCM(particle p, dis_kinematics k) {
+    if (!(p.is_hadron && k.is_valid)) return 0;
+    double m_n  = pid_mass(2112);
+    double m_pi = pid_mass(211);
+    return sqrt(pow(k.W*k.W - m_n*m_n + m_pi*m_pi, 2) - 4*m_pi*m_pi*k.W*k.W) / (2*k.W);
 }
 
 // Return the momentum transverse component squared of the produced particle wrt the virtual photon
 //     direction.
-float PTrans2PQ(particle p, particle e, double bE) {
-    if (!(p.is_hadron&&e.is_trigger_electron)) return 0;
-    return P(p)*P(p) * (1 - cos_theta_pq(p,e,bE)*cos_theta_pq(p,e,bE));
+float PTrans2PQ(particle p, dis_kinematics k) {
+    return Pt2(p, k);
 }
 
 // Return the momentum longitudinal component squared of the produced particle wrt the virtual
 //     photon direction.
-float PLong2PQ(particle p, particle e, double bE) {
-    if (!(p.is_hadron&&e.is_trigger_electron)) return 0;
-    return P(p)*P(p) * cos_theta_pq(p,e,bE)*cos_theta_pq(p,e,bE);
+float PLong2PQ(particle p, dis_kinematics k) {
+    return Pl2(p, k);
 }
 
 // Calculate X_f (X Feynmann).
-float Xf(particle p, particle e, double bE) {
-    if (!(p.is_hadron&&e.is_trigger_electron)) return 0;
-    return PlCM(p,e,bE) / PmaxCM(p,e,bE);
+float Xf(particle p, dis_kinematics k) {
+    if (!(p.is_hadron && k.is_valid)) return 0;
+    return PlCM(p, k) / PmaxCM(p, k);
 }
 
 // Compute the missing mass
-float Mx2(particle p, particle e, double bE) {
-    if (!(p.is_hadron&&e.is_trigger_electron)) return 0;
-    return W(e,bE)*W(e,bE) - 2*nu(e,bE)*zh(p,e,bE) * (nu(e,bE) + MASS.at(2212)) + MASS.at(211)*MASS.at(211)
-            + 2*sqrt((Q2(e,bE) + nu(e,bE)*nu(e,bE)) * Pl2(p,e,bE));
+float Mx2(particle p, dis_kinematics k) {
+    if (!(p.is_hadron && k.is_valid)) return 0;
+    double m_pi = pid_mass(211);
+    return k.W*k.W - 2*k.nu*zh(p, k) * (k.nu + pid_mass(2212)) + m_pi*m_pi
+            + 2*k.q*sqrt(Pl2(p, k));
 }
 
 // Compute Mandelstam t. TODO. Make sure that that is what this is!
-float t_mandelstam(particle p, particle e, double bE) {
-    if (!(p.is_hadron&&e.is_trigger_electron)) return 0;
-    return 2*sqrt((nu(e,bE)*nu(e,bE) + Q2(e,bE)) * Pl2(p,e,bE)) + MASS.at(211)*MASS.at(211) - Q2(e,bE)
-            - 2*nu(e,bE)*nu(e,bE)*zh(p,e,bE);
+float t_mandelstam(particle p, dis_kinematics k) {
+    if (!(p.is_hadron && k.is_valid)) return 0;
+    double m_pi = pid_mass(211);
+    return 2*k.q*sqrt(Pl2(p, k)) + m_pi*m_pi - k.Q2 - 2*k.nu*k.nu*zh(p, k);
+}
+
+// === BATCH FUNCTIONS =============================================================================
+// Add a particle to a batch. If `k` is not valid or the particle is not a hadron, its SIDIS
+//     variables will be set to 0, same as their scalar counterparts.
+int particle_batch_add(particle_batch * b, particle p, dis_kinematics k) {
+    bool is_sidis = p.is_hadron && k.is_valid;
+
+    b->px  .push_back(p.px);
+    b->py  .push_back(p.py);
+    b->pz  .push_back(p.pz);
+    b->mass.push_back(p.mass);
+    b->is_sidis.push_back(is_sidis);
+
+    // Use harmless values for invalid kinematics, so that no operation in the batch divides by 0.
+    b->nu       .push_back(is_sidis ? k.nu        : 1);
+    b->qx       .push_back(is_sidis ? k.qx        : 0);
+    b->qy       .push_back(is_sidis ? k.qy        : 0);
+    b->qz       .push_back(is_sidis ? k.qz        : 1);
+    b->q        .push_back(is_sidis ? k.q         : 1);
+    b->cos_phi_z.push_back(is_sidis ? k.cos_phi_z : 1);
+    b->sin_phi_z.push_back(is_sidis ? k.sin_phi_z : 0);
+    b->cos_phi_y.push_back(is_sidis ? k.cos_phi_y : 1);
+    b->sin_phi_y.push_back(is_sidis ? k.sin_phi_y : 0);
+
+    return 0;
+}
+
+// Get number of particles in batch.
+int particle_batch_size(particle_batch * b) {
+    return b->px.size();
+}
+
+// Remove all particles from batch, keeping the allocated memory.
+int particle_batch_clear(particle_batch * b) {
+    b->px  .clear(); b->py  .clear(); b->pz  .clear(); b->mass.clear();
+    b->is_sidis.clear();
+    b->nu.clear(); b->qx.clear(); b->qy.clear(); b->qz.clear(); b->q.clear();
+    b->cos_phi_z.clear(); b->sin_phi_z.clear(); b->cos_phi_y.clear(); b->sin_phi_y.clear();
+    b->p  .clear(); b->theta.clear(); b->phi.clear();
+    b->zh .clear(); b->pt2  .clear(); b->pl2.clear(); b->phipq.clear(); b->thetapq.clear();
+
+    return 0;
+}
+
+// Compute lab frame and SIDIS kinematics for all particles in a batch. Loops are kept free of
+//     branches and function calls other than math intrinsics so that the compiler can vectorize
+//     them. Results match the scalar functions to float precision.
+int particle_batch_kinematics(particle_batch * b) {
+    int n = particle_batch_size(b);
+    b->p  .resize(n); b->theta.resize(n); b->phi.resize(n);
+    b->zh .resize(n); b->pt2  .resize(n); b->pl2.resize(n); b->phipq.resize(n);
+    b->thetapq.resize(n);
+
+    const float * px = b->px.data();
+    const float * py = b->py.data();
+    const float * pz = b->pz.data();
+    const float * m  = b->mass.data();
+    const char  * is_sidis = b->is_sidis.data();
+    const double * nu = b->nu.data();
+    const double * qx = b->qx.data();
+    const double * qy = b->qy.data();
+    const double * qz = b->qz.data();
+    const double * q  = b->q .data();
+    const double * cz = b->cos_phi_z.data();
+    const double * sz = b->sin_phi_z.data();
+    const double * cy = b->cos_phi_y.data();
+    const double * sy = b->sin_phi_y.data();
+
+    // Lab frame.
+    float * p     = b->p    .data();
+    float * theta = b->theta.data();
+    float * phi   = b->phi  .data();
+    for (int i = 0; i < n; ++i) {
+        double x = px[i], y = py[i], z = pz[i];
+        p    [i] = calc_magnitude(x, y, z);
+        theta[i] = calc_theta_lab(x, y, z);
+        phi  [i] = calc_phi_lab(x, y);
+    }
+
+    // Virtual photon frame.
+    float * zh      = b->zh     .data();
+    float * pt2     = b->pt2    .data();
+    float * pl2     = b->pl2    .data();
+    float * phipq   = b->phipq  .data();
+    float * thetapq = b->thetapq.data();
+    for (int i = 0; i < n; ++i) {
+        double x = px[i], y = py[i], z = pz[i];
+        double pl = calc_Pl(x, y, z, qx[i], qy[i], qz[i], q[i]);
+        zh [i] = is_sidis[i] ? calc_zh(x, y, z, (double) m[i], nu[i]) : 0;
+        pt2[i] = is_sidis[i] ? calc_Pt2(x, y, z, pl)                 : 0;
+        pl2[i] = is_sidis[i] ? pl*pl                                 : 0;
+    }
+
+    for (int i = 0; i < n; ++i) {
+        double x = px[i], y = py[i], z = pz[i];
+        double pl = calc_Pl(x, y, z, qx[i], qy[i], qz[i], q[i]);
+        thetapq[i] = is_sidis[i] ? calc_theta_pq((double) pt2[i], pl)                  : 0;
+        phipq  [i] = is_sidis[i] ? calc_phi_pq(x, y, z, cz[i], sz[i], cy[i], sy[i]) : 0;
+    }
+
+    return 0;
 }
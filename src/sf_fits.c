@@ -0,0 +1,756 @@
+// CLAS12 RG-E Analyser.
+// Copyright (C) 2022 Bruno Benkel
+//
+// This program is free software: you can redistribute it and/or modify it under the terms of the
+// GNU Lesser General Public License as published by the Free Software Foundation, either version 3
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+// even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// Lesser General Public License for more details.
+//
+// You can see a copy of the GNU Lesser Public License under the LICENSE file.
+
+#include "../lib/sf_fits.h"
+
+// Book all sampling fraction histograms. The momentum axis of the 2D histograms starts at SF_PMIN
+//     and has SF_PSUBDIV bins per momentum bin, so that momentum bins are slices of whole bins.
+int book_sf_histos(sf_histos * h) {
+    memset(h->sf_mom, 0, sizeof(h->sf_mom));
+
+    int ci = -1;
+    for (const char *cal : SFARR2D) {
+        ci++;
+        for (int si = 0; si < NSECTORS; ++si) {
+            h->sf2D_h[ci][si] = book_TH2F(&(h->histos), R_PALL, Form("%s%d)", cal, si+1), S_P,
+                                          S_EDIVP, SF_NPBINS*SF_PSUBDIV, SF_PMIN,
+                                          SF_PMIN + SF_NPBINS*SF_PSTEP, 200, 0, 0.4);
+        }
+    }
+
+    return 0;
+}
+
+// Get lower edges of momentum bins, accumulated the same way as when booking histograms so that
+//     bins and names match exactly. Returns the number of edges.
+int get_sf_pedges(double p_edges[SF_NPBINS]) {
+    int p_nedges = 0;
+    for (double p = SF_PMIN; p <= SF_PMAX && p_nedges < SF_NPBINS; p += SF_PSTEP)
+        p_edges[p_nedges++] = p;
+    return p_nedges;
+}
+
+// Fill the sampling fractions of one track with momentum tot_P, given the energy it deposited in
+//     each calorimeter and sector. The total calorimeter energy is computed here. Tracks out of the
+//     momentum bins are skipped.
+int fill_sf_track(sf_histos *h, double tot_P, double sf_E[SF_NCALS][NSECTORS], long *nfills) {
+    for (int ci = 0; ci < SF_NCALS-1; ++ci) {
+        for (int si = 0; si < NSECTORS; ++si) sf_E[CALS_IDX][si] += sf_E[ci][si];
+    }
+
+    // Get momentum bin from the 2D histograms' axis, so that moments match their slices.
+    TAxis *p_axis = h->histos.histos[h->sf2D_h[0][0]]->GetXaxis();
+    int    p_bin  = p_axis->FindFixBin(tot_P);
+    if (p_bin < 1 || p_bin > p_axis->GetNbins()) return 0;
+    int pi = (p_bin - 1) / SF_PSUBDIV;
+
+    // Write to histograms.
+    for (int ci = 0; ci < SF_NCALS; ++ci) {
+        for (int si = 0; si < NSECTORS; ++si) {
+            if (sf_E[ci][si] <= 0) continue;
+            double sf = sf_E[ci][si]/tot_P;
+            h->histos.histos[h->sf2D_h[ci][si]]->Fill(tot_P, sf);
+            (*nfills)++;
+
+            // Update streaming moments.
+            if (sf <= PLIMITSARR[ci][0] || sf >= PLIMITSARR[ci][1]) continue;
+            long long x   = llround(sf * SF_MOM_SCALE);
+            long long *m = h->sf_mom[ci][si][pi];
+            m[0]++;
+            m[1] += x;
+            m[2] += x*x;
+        }
+    }
+
+    return 0;
+}
+
+// Project the E/p distribution of each momentum bin from the 2D histograms. Projections are named
+//     as the 1D histograms they replace. Project them in the main thread, since ROOT registers them
+//     in the current directory while projecting. Free them with free_sf_slices().
+int project_sf_slices(sf_histos *h, TH1 *slices[SF_NCALS][NSECTORS][SF_NPBINS]) {
+    double p_edges[SF_NPBINS];
+    get_sf_pedges(p_edges);
+
+    for (int ci = 0; ci < SF_NCALS; ++ci) {
+        for (int si = 0; si < NSECTORS; ++si) {
+            TH2 *sf2D = (TH2 *) h->histos.histos[h->sf2D_h[ci][si]];
+            for (int pi = 0; pi < SF_NPBINS; ++pi) {
+                char name[128];
+                snprintf(name, sizeof(name), "%s%d (%5.2f < p < %5.2f)", SFARR1D[ci], si+1,
+                         p_edges[pi], p_edges[pi]+SF_PSTEP);
+                slices[ci][si][pi] = sf2D->ProjectionY(Form("%s: %s", R_PALL, name),
+                                                       pi*SF_PSUBDIV + 1, (pi+1)*SF_PSUBDIV);
+                slices[ci][si][pi]->SetTitle(Form("%s;%s", name, S_EDIVP));
+                slices[ci][si][pi]->SetDirectory(0);
+            }
+        }
+    }
+
+    return 0;
+}
+
+// Delete the projections made by project_sf_slices().
+int free_sf_slices(TH1 *slices[SF_NCALS][NSECTORS][SF_NPBINS]) {
+    for (int ci = 0; ci < SF_NCALS; ++ci) {
+        for (int si = 0; si < NSECTORS; ++si) {
+            for (int pi = 0; pi < SF_NPBINS; ++pi) delete slices[ci][si][pi];
+        }
+    }
+    return 0;
+}
+
+// Add the histograms and moments of src to dst.
+int merge_sf_histos(sf_histos *dst, sf_histos *src) {
+    for (UInt_t hi = 0; hi < dst->histos.histos.size(); ++hi)
+        dst->histos.histos[hi]->Add(src->histos.histos[hi]);
+
+    long long *mom_dst = &(dst->sf_mom[0][0][0][0]);
+    long long *mom_src = &(src->sf_mom[0][0][0][0]);
+    for (int mi = 0; mi < SF_NMOMS; ++mi) mom_dst[mi] += mom_src[mi];
+
+    return 0;
+}
+
+// Delete the histograms in h.
+int free_sf_histos(sf_histos *h) {
+    for (UInt_t hi = 0; hi < h->histos.histos.size(); ++hi) delete h->histos.histos[hi];
+    h->histos.histos.clear();
+    return 0;
+}
+
+// Empty the histograms and moments in h, keeping them booked.
+int reset_sf_histos(sf_histos *h) {
+    for (UInt_t hi = 0; hi < h->histos.histos.size(); ++hi) h->histos.histos[hi]->Reset();
+    memset(h->sf_mom, 0, sizeof(h->sf_mom));
+    return 0;
+}
+
+// Write the histograms and moments in h to a state file, along with the run number, whether FMT
+//     data was used, and the number of events read. Returns 1 if the file can't be created.
+int write_sf_state(sf_histos *h, const char *filename, int run_no, bool use_fmt, long nevents) {
+    TFile *f = TFile::Open(filename, "RECREATE");
+    if (!f || f->IsZombie()) return 1;
+
+    for (UInt_t hi = 0; hi < h->histos.histos.size(); ++hi) h->histos.histos[hi]->Write();
+
+    Long64_t nevents_l = nevents;
+    char moments_leaf[32];
+    snprintf(moments_leaf, sizeof(moments_leaf), "moments[%d]/L", SF_NMOMS);
+    TTree *t = new TTree(SF_STATE_TREE, SF_STATE_TREE);
+    t->Branch("run_no",  &run_no,    "run_no/I");
+    t->Branch("use_fmt", &use_fmt,   "use_fmt/O");
+    t->Branch("nevents", &nevents_l, "nevents/L");
+    t->Branch("moments", &(h->sf_mom[0][0][0][0]), moments_leaf);
+    t->Fill();
+    t->Write();
+
+    f->Close();
+    return 0;
+}
+
+// Add the histograms and moments of a state file to h, and get the run number, whether FMT data
+//     was used, and the number of events read from it. Returns 1 if the file can't be opened, and 2
+//     if it's not a valid state file.
+int read_sf_state(sf_histos *h, const char *filename, int *run_no, bool *use_fmt, long *nevents) {
+    TFile *f = TFile::Open(filename, "READ");
+    if (!f || f->IsZombie()) return 1;
+
+    TTree *t = f->Get<TTree>(SF_STATE_TREE);
+    if (t == NULL) return 2;
+    Long64_t nevents_l;
+    std::vector<long long> mom(SF_NMOMS);
+    t->SetBranchAddress("run_no",  run_no);
+    t->SetBranchAddress("use_fmt", use_fmt);
+    t->SetBranchAddress("nevents", &nevents_l);
+    t->SetBranchAddress("moments", mom.data());
+    t->GetEntry(0);
+    *nevents = nevents_l;
+
+    for (UInt_t hi = 0; hi < h->histos.histos.size(); ++hi) {
+        TH1 *f_histo = f->Get<TH1>(h->histos.histos[hi]->GetName());
+        if (f_histo == NULL) return 2;
+        f_histo->SetDirectory(0);
+        bool added = h->histos.histos[hi]->Add(f_histo); // Fails if the binning doesn't match.
+        delete f_histo;
+        if (!added) return 2;
+    }
+
+    long long *h_mom = &(h->sf_mom[0][0][0][0]);
+    for (int mi = 0; mi < SF_NMOMS; ++mi) h_mom[mi] += mom[mi];
+
+    f->Close();
+    return 0;
+}
+
+// Get fit seeds from a reference run, either from its sf_params file (.txt) or from a state file
+//     (.root). sf_params files only hold the total calorimeter's dotgraph fit, which seeds that fit
+//     and the means of its momentum bins. State files are fitted with the fast fits, which seed all
+//     bins and dotgraphs that they could fit. Returns 1 if the file can't be opened, and 2 if it's
+//     not a valid sf_params or state file.
+int get_sf_seeds(sf_seeds *seeds, char *filename) {
+    memset(seeds, 0, sizeof(*seeds));
+    double p_edges[SF_NPBINS];
+    get_sf_pedges(p_edges);
+
+    if (strstr(filename, ".txt")) {
+        double sf[NSECTORS][SF_NPARAMS][2];
+        if (get_sf_params(filename, sf)) return 1;
+        for (int si = 0; si < NSECTORS; ++si) {
+            double *g = seeds->graph[CALS_IDX][si];
+            for (int pi = 0; pi < SF_NPARAMS; ++pi) g[pi] = sf[si][pi][0];
+            seeds->has_graph[CALS_IDX][si] = true;
+
+            for (int pi = 0; pi < SF_NPBINS; ++pi) {
+                double p    = p_edges[pi] + SF_PSTEP/2;
+                double mean = g[0]*(g[1] + g[2]/p + g[3]/(p*p));
+                if (!(mean > PLIMITSARR[CALS_IDX][0] && mean < PLIMITSARR[CALS_IDX][1])) continue;
+                seeds->bin[CALS_IDX][si][pi][0] = mean;
+                seeds->bin[CALS_IDX][si][pi][1] = 0.05;
+                seeds->has_bin[CALS_IDX][si][pi] = true;
+            }
+        }
+        return 0;
+    }
+    if (!strstr(filename, ".root")) return 2;
+
+    sf_histos h;
+    book_sf_histos(&h);
+    int  run_no;
+    bool use_fmt;
+    long nevents;
+    int chk = read_sf_state(&h, filename, &run_no, &use_fmt, &nevents);
+    if (chk) {
+        free_sf_histos(&h);
+        return chk;
+    }
+
+    TH1 *slices[SF_NCALS][NSECTORS][SF_NPBINS];
+    project_sf_slices(&h, slices);
+    TGraphErrors *dotgraph[SF_NCALS][NSECTORS];
+    TF1 *polyfit[SF_NCALS][NSECTORS];
+    init_sf_fits(dotgraph, polyfit, " seed");
+    for (int ci = 0; ci < SF_NCALS; ++ci) {
+        for (int si = 0; si < NSECTORS; ++si) {
+            sf_binfit r[SF_NPBINS];
+            for (int pi = 0; pi < SF_NPBINS; ++pi) {
+                fit_sf_bin_fast(slices[ci][si][pi], h.sf_mom[ci][si][pi], ci, &(r[pi]));
+                if (!r[pi].is_valid) continue;
+                seeds->bin[ci][si][pi][0] = r[pi].mean;
+                seeds->bin[ci][si][pi][1] = fmin(r[pi].sigma, 0.1);
+                seeds->has_bin[ci][si][pi] = true;
+            }
+
+            double fitresults[SF_NPARAMS][2];
+            if (fit_sf_graph_fast(r, p_edges, dotgraph[ci][si], polyfit[ci][si], fitresults) == 0) {
+                for (int pi = 0; pi < SF_NPARAMS; ++pi)
+                    seeds->graph[ci][si][pi] = fitresults[pi][0];
+                seeds->has_graph[ci][si] = true;
+            }
+            delete dotgraph[ci][si];
+            delete polyfit[ci][si];
+        }
+    }
+    free_sf_slices(slices);
+    free_sf_histos(&h);
+
+    return 0;
+}
+
+// Fit a Gaussian with a 2nd degree polynomial background to the E/p histogram of one momentum bin,
+//     with lower edge p. The Gaussian starts from seed's mean and sigma, or from constants if seed
+//     is NULL. The TF1 name is written to a local buffer since Form()'s buffer is shared.
+int fit_sf_bin(TH1 *EdivP, int ci, int si, double p, const double seed[2], sf_binfit *r) {
+    // Form fit string name.
+    char name[128];
+    snprintf(name, sizeof(name), "%s%d (%5.2f < p < %5.2f) fit", SFARR1D[ci], si+1, p,
+             p+SF_PSTEP);
+
+    // Fit.
+    TF1 *sf_gaus = new TF1(name, "[0]*TMath::Gaus(x,[1],[2]) + [3]*x*x + [4]*x + [5]",
+                           PLIMITSARR[ci][0], PLIMITSARR[ci][1]);
+    sf_gaus->SetParameter(0 /* amp   */, EdivP->GetBinContent(EdivP->GetMaximumBin()));
+    sf_gaus->SetParLimits(1, PLIMITSARR[ci][0], PLIMITSARR[ci][1]);
+    sf_gaus->SetParameter(1 /* mean  */,
+                          seed ? seed[0] : (PLIMITSARR[ci][1] + PLIMITSARR[ci][0])/2);
+    sf_gaus->SetParLimits(2, 0., 0.1);
+    sf_gaus->SetParameter(2 /* sigma */, seed ? seed[1] : 0.05);
+    sf_gaus->SetParameter(3 /* p0 */,    0);
+    sf_gaus->SetParameter(4 /* p1 */,    0);
+    sf_gaus->SetParameter(5 /* p2 */,    0);
+    TFitResultPtr fit = EdivP->Fit(sf_gaus, "QRS", "", PLIMITSARR[ci][0], PLIMITSARR[ci][1]);
+
+    // Extract mean and sigma from fit.
+    r->mean   = sf_gaus->GetParameter(1);
+    r->sigma  = sf_gaus->GetParameter(2);
+    r->status = fit;
+    r->ncalls = fit.Get() ? fit->NCalls() : 0;
+
+    // Only accept points within PLIMITSARR borders and with an acceptable chi2.
+    r->is_valid = (r->mean - 2*r->sigma > PLIMITSARR[ci][0]
+                    && r->mean + 2*r->sigma < PLIMITSARR[ci][1])
+            && (sf_gaus->GetChisquare() / sf_gaus->GetNDF() < SF_CHI2CONFORMITY);
+
+    return 0;
+}
+
+// Add the valid bin fits to the dotgraph in momentum order, fit it, and save the parameters. The
+//     fit starts from seed, or from polyfit's current parameters if seed is NULL. Returns Minuit's
+//     status, or -1 if there's no valid points.
+int fit_sf_graph(sf_binfit r[SF_NPBINS], double p_edges[SF_NPBINS], TGraphErrors *dotgraph,
+                 TF1 *polyfit, const double seed[SF_NPARAMS], double fitresults[SF_NPARAMS][2],
+                 int *ncalls) {
+    int point_index = 0;
+    for (int pi = 0; pi < SF_NPBINS; ++pi) {
+        if (!r[pi].is_valid) continue;
+        dotgraph->SetPoint(point_index, p_edges[pi] + SF_PSTEP/2, r[pi].mean);
+        point_index++;
+    }
+
+    // Fit dotgraphs.
+    int status = -1;
+    * ncalls   = 0;
+    if (seed) polyfit->SetParameters(seed);
+    if (dotgraph->GetN() > 0) {
+        TFitResultPtr fit = dotgraph->Fit(polyfit, "QRS", "", SF_PMIN+SF_PSTEP, SF_PMAX-SF_PSTEP);
+        status   = fit;
+        * ncalls = fit.Get() ? fit->NCalls() : 0;
+    }
+
+    // Extract and save dotgraph fits parameters to make cuts from them.
+    for (int pi = 0; pi < polyfit->GetNpar(); ++pi) {
+        fitresults[pi][0] = polyfit->GetParameter(pi); // sf.
+        fitresults[pi][1] = polyfit->GetParError(pi);  // sfs.
+    }
+
+    return status;
+}
+
+// Run the sampling fraction fits of the (calorimeter, sector) pairs in mask with nthreads workers,
+//     using Minuit. Workers take (calorimeter, sector, momentum bin) fits in order from a shared
+//     counter, and the worker finishing the last bin of a (calorimeter, sector) pair runs its
+//     dotgraph fit right away. Each fit only depends on its own histogram, and dotgraphs are filled
+//     in momentum order, so results don't depend on nthreads. Fits start from seeds where they're
+//     available, and their convergence statistics are added to stats.
+int fit_sf(TH1 *slices[SF_NCALS][NSECTORS][SF_NPBINS], TGraphErrors *dotgraph[SF_NCALS][NSECTORS],
+           TF1 *polyfit[SF_NCALS][NSECTORS], double fitresults[SF_NCALS][NSECTORS][SF_NPARAMS][2],
+           bool mask[SF_NCALS][NSECTORS], int nthreads, const sf_seeds *seeds,
+           sf_fitstats *stats) {
+    double p_edges[SF_NPBINS];
+    get_sf_pedges(p_edges);
+
+    // TMinuit isn't thread-safe, so Minuit2 is used for any number of workers.
+    ROOT::Math::MinimizerOptions::SetDefaultMinimizer("Minuit2");
+
+    sf_binfit r[SF_NCALS][NSECTORS][SF_NPBINS];
+    int graph_status[SF_NCALS][NSECTORS];
+    int graph_ncalls[SF_NCALS][NSECTORS];
+    std::atomic<int> bins_left[SF_NCALS][NSECTORS];
+    for (int ci = 0; ci < SF_NCALS; ++ci) {
+        for (int si = 0; si < NSECTORS; ++si) bins_left[ci][si] = SF_NPBINS;
+    }
+
+    const int ntasks = SF_NCALS * NSECTORS * SF_NPBINS;
+    std::atomic<int> next_task(0);
+    auto worker = [&]() {
+        for (int ti = next_task++; ti < ntasks; ti = next_task++) {
+            int ci = ti / (NSECTORS * SF_NPBINS);
+            int si = (ti / SF_NPBINS) % NSECTORS;
+            int pi = ti % SF_NPBINS;
+            if (!mask[ci][si]) continue;
+            bool bin_seeded   = seeds && seeds->has_bin[ci][si][pi];
+            bool graph_seeded = seeds && seeds->has_graph[ci][si];
+            fit_sf_bin(slices[ci][si][pi], ci, si, p_edges[pi],
+                       bin_seeded ? seeds->bin[ci][si][pi] : NULL, &(r[ci][si][pi]));
+            if (--bins_left[ci][si] == 0) {
+                graph_status[ci][si] = fit_sf_graph(r[ci][si], p_edges, dotgraph[ci][si],
+                        polyfit[ci][si], graph_seeded ? seeds->graph[ci][si] : NULL,
+                        fitresults[ci][si], &(graph_ncalls[ci][si]));
+            }
+        }
+    };
+
+    if (nthreads == 1) {
+        worker();
+    }
+    else {
+        std::vector<std::thread> workers;
+        for (int wi = 0; wi < nthreads; ++wi) workers.push_back(std::thread(worker));
+        for (int wi = 0; wi < nthreads; ++wi) workers[wi].join();
+    }
+
+    // Gather convergence statistics.
+    for (int ci = 0; ci < SF_NCALS; ++ci) {
+        for (int si = 0; si < NSECTORS; ++si) {
+            if (!mask[ci][si]) continue;
+            for (int pi = 0; pi < SF_NPBINS; ++pi) {
+                stats->bin_fits++;
+                stats->bin_calls += r[ci][si][pi].ncalls;
+                if (r[ci][si][pi].status != 0) stats->bin_failed++;
+                if (!r[ci][si][pi].is_valid)   stats->bin_rejected++;
+            }
+            stats->graph_fits++;
+            stats->graph_calls += graph_ncalls[ci][si];
+            if (graph_status[ci][si] != 0) stats->graph_failed++;
+        }
+    }
+
+    return 0;
+}
+
+// Fast alternative to fit_sf_bin(). Mean and width are seeded from the streaming moments, and then
+//     refined with SF_FAST_NITER iterations of moments of the histogram truncated at SF_FAST_NSIGMA
+//     sigmas. The width is corrected for the truncation assuming a Gaussian peak. Returns 1 if
+//     there's not enough entries.
+int fit_sf_bin_fast(TH1 *EdivP, long long mom[3], int ci, sf_binfit *r) {
+    r->is_valid = false;
+    if (mom[0] < SF_FAST_MINN) return 1;
+
+    // Seed from streaming moments.
+    double n = mom[0];
+    r->mean  = (mom[1]/n) / SF_MOM_SCALE;
+    r->sigma = sqrt(fmax(mom[2]/n - (mom[1]/n)*(mom[1]/n), 0)) / SF_MOM_SCALE;
+
+    // Iterate truncated moments.
+    double k    = SF_FAST_NSIGMA;
+    double corr = sqrt(1 - 2*k*exp(-k*k/2)/sqrt(2*M_PI) / erf(k/sqrt(2)));
+    double w    = n;
+    for (int it = 0; it < SF_FAST_NITER; ++it) {
+        double lo = fmax(r->mean - k*r->sigma, PLIMITSARR[ci][0]);
+        double hi = fmin(r->mean + k*r->sigma, PLIMITSARR[ci][1]);
+        double sw = 0, swx = 0, swxx = 0;
+        for (int bi = EdivP->GetXaxis()->FindBin(lo); bi <= EdivP->GetXaxis()->FindBin(hi); ++bi) {
+            double x = EdivP->GetXaxis()->GetBinCenter(bi);
+            double c = EdivP->GetBinContent(bi);
+            sw   += c;
+            swx  += c*x;
+            swxx += c*x*x;
+        }
+        if (sw < SF_FAST_MINN) return 1;
+        r->mean  = swx/sw;
+        r->sigma = sqrt(fmax(swxx/sw - r->mean*r->mean, 0)) / corr;
+        w        = sw;
+    }
+    r->mean_err = r->sigma / sqrt(w);
+
+    // Only accept points within PLIMITSARR borders.
+    r->is_valid = r->sigma > 0 && r->mean - 2*r->sigma > PLIMITSARR[ci][0]
+            && r->mean + 2*r->sigma < PLIMITSARR[ci][1];
+
+    return 0;
+}
+
+// Fast alternative to fit_sf_graph(). Since [0] only scales the other parameters, the
+//     parametrization is solved for [0] = 1 as [1] + [2]/p + [3]/p^2 by weighted linear least
+//     squares, using the same fit range. Returns 1 if there's not enough points to solve it.
+int fit_sf_graph_fast(sf_binfit r[SF_NPBINS], double p_edges[SF_NPBINS], TGraphErrors *dotgraph,
+                      TF1 *polyfit, double fitresults[SF_NPARAMS][2]) {
+    // Build normal equations.
+    double A[3][3] = {{0}};
+    double B[3]    = {0};
+    int    npoints = 0;
+    for (int pi = 0; pi < SF_NPBINS; ++pi) {
+        double x = p_edges[pi] + SF_PSTEP/2;
+        if (!r[pi].is_valid || x < SF_PMIN+SF_PSTEP || x > SF_PMAX-SF_PSTEP) continue;
+        double f[3] = {1, 1/x, 1/(x*x)};
+        double w    = 1/(r[pi].mean_err*r[pi].mean_err);
+        for (int i = 0; i < 3; ++i) {
+            for (int j = 0; j < 3; ++j) A[i][j] += w*f[i]*f[j];
+            B[i] += w*f[i]*r[pi].mean;
+        }
+        npoints++;
+    }
+    if (npoints < 3) return 1;
+
+    // Invert A. Its inverse is the covariance matrix of the parameters.
+    double C[3][3];
+    for (int i = 0; i < 3; ++i) {
+        for (int j = 0; j < 3; ++j) {
+            C[j][i] = A[(i+1)%3][(j+1)%3]*A[(i+2)%3][(j+2)%3]
+                    - A[(i+1)%3][(j+2)%3]*A[(i+2)%3][(j+1)%3];
+        }
+    }
+    double det = A[0][0]*C[0][0] + A[0][1]*C[1][0] + A[0][2]*C[2][0];
+    if (!(fabs(det) > 0)) return 1;
+
+    // Save parameters.
+    fitresults[0][0] = 1;
+    fitresults[0][1] = 0;
+    polyfit->SetParameter(0, 1);
+    polyfit->SetParError (0, 0);
+    for (int i = 0; i < 3; ++i) {
+        fitresults[i+1][0] = (C[i][0]*B[0] + C[i][1]*B[1] + C[i][2]*B[2]) / det;
+        fitresults[i+1][1] = sqrt(C[i][i] / det);
+        polyfit->SetParameter(i+1, fitresults[i+1][0]);
+        polyfit->SetParError (i+1, fitresults[i+1][1]);
+    }
+
+    // Fill dotgraph.
+    int point_index = 0;
+    for (int pi = 0; pi < SF_NPBINS; ++pi) {
+        if (!r[pi].is_valid) continue;
+        dotgraph->SetPoint     (point_index, p_edges[pi] + SF_PSTEP/2, r[pi].mean);
+        dotgraph->SetPointError(point_index, 0, r[pi].mean_err);
+        point_index++;
+    }
+
+    return 0;
+}
+
+// Run the fast sampling fraction fits. Pairs of (calorimeter, sector) that couldn't be fitted are
+//     flagged in `failed`. Returns the number of flagged pairs.
+int fit_sf_fast(sf_histos *h, TH1 *slices[SF_NCALS][NSECTORS][SF_NPBINS],
+                TGraphErrors *dotgraph[SF_NCALS][NSECTORS],
+                TF1 *polyfit[SF_NCALS][NSECTORS],
+                double fitresults[SF_NCALS][NSECTORS][SF_NPARAMS][2],
+                bool failed[SF_NCALS][NSECTORS]) {
+    double p_edges[SF_NPBINS];
+    get_sf_pedges(p_edges);
+
+    int nfailed = 0;
+    for (int ci = 0; ci < SF_NCALS; ++ci) {
+        for (int si = 0; si < NSECTORS; ++si) {
+            sf_binfit r[SF_NPBINS];
+            for (int pi = 0; pi < SF_NPBINS; ++pi) {
+                fit_sf_bin_fast(slices[ci][si][pi], h->sf_mom[ci][si][pi], ci, &(r[pi]));
+            }
+            failed[ci][si] = fit_sf_graph_fast(r, p_edges, dotgraph[ci][si], polyfit[ci][si],
+                                               fitresults[ci][si]);
+            if (failed[ci][si]) nfailed++;
+        }
+    }
+
+    return nfailed;
+}
+
+// Get the largest parameter uncertainty of the fast fits over all calorimeters and sectors, used to
+//     tell when enough events were read. Returns INFINITY if any fast fit fails.
+double sf_max_error(sf_histos *h, TGraphErrors *dotgraph[SF_NCALS][NSECTORS],
+                    TF1 *polyfit[SF_NCALS][NSECTORS]) {
+    double fitresults[SF_NCALS][NSECTORS][SF_NPARAMS][2];
+    bool   failed[SF_NCALS][NSECTORS];
+    TH1   *slices[SF_NCALS][NSECTORS][SF_NPBINS];
+    project_sf_slices(h, slices);
+    int nfailed = fit_sf_fast(h, slices, dotgraph, polyfit, fitresults, failed);
+    free_sf_slices(slices);
+    if (nfailed > 0) return INFINITY;
+
+    double max_err = 0;
+    for (int ci = 0; ci < SF_NCALS; ++ci) {
+        for (int si = 0; si < NSECTORS; ++si) {
+            for (int pi = 0; pi < SF_NPARAMS; ++pi)
+                max_err = fmax(max_err, fitresults[ci][si][pi][1]);
+        }
+    }
+
+    return max_err;
+}
+
+// Print a per-parameter comparison between fast and Minuit fit results. Since [0] only scales the
+//     other parameters, [1], [2], and [3] are compared multiplied by [0]. The largest difference in
+//     the parametrized SF over the fit range is printed too.
+int print_sf_comparison(double fast[SF_NCALS][NSECTORS][SF_NPARAMS][2],
+                        double minuit[SF_NCALS][NSECTORS][SF_NPARAMS][2],
+                        bool fast_failed[SF_NCALS][NSECTORS]) {
+    printf("\n%-5s %-6s %-20s %-20s %-20s %s\n", "cal", "sector", "[0]*[1] fast/Minuit",
+           "[0]*[2] fast/Minuit", "[0]*[3] fast/Minuit", "max |dSF|");
+    for (int ci = 0; ci < SF_NCALS; ++ci) {
+        for (int si = 0; si < NSECTORS; ++si) {
+            printf("%-5s %-6d ", CALNAME[ci], si+1);
+            if (fast_failed[ci][si]) {
+                printf("fast fit failed.\n");
+                continue;
+            }
+            double cf[3], cm[3];
+            for (int i = 0; i < 3; ++i) {
+                cf[i] = fast  [ci][si][0][0] * fast  [ci][si][i+1][0];
+                cm[i] = minuit[ci][si][0][0] * minuit[ci][si][i+1][0];
+                printf("%9.5f/%-10.5f ", cf[i], cm[i]);
+            }
+            double max_diff = 0;
+            for (double p = SF_PMIN+SF_PSTEP; p <= SF_PMAX-SF_PSTEP; p += SF_PSTEP/4) {
+                double diff = fabs((cf[0] + cf[1]/p + cf[2]/(p*p))
+                                   - (cm[0] + cm[1]/p + cm[2]/(p*p)));
+                if (diff > max_diff) max_diff = diff;
+            }
+            printf("%.5f\n", max_diff);
+        }
+    }
+    printf("\n");
+
+    return 0;
+}
+
+// Print the convergence statistics of a set of Minuit fits.
+int print_sf_fitstats(sf_fitstats *stats) {
+    printf("Minuit bin fits: %d, %.1f calls per fit, %d not converged, %d rejected.\n",
+           stats->bin_fits, stats->bin_fits > 0 ? (double) stats->bin_calls/stats->bin_fits : 0.,
+           stats->bin_failed, stats->bin_rejected);
+    printf("Minuit dotgraph fits: %d, %.1f calls per fit, %d not converged.\n", stats->graph_fits,
+           stats->graph_fits > 0 ? (double) stats->graph_calls/stats->graph_fits : 0.,
+           stats->graph_failed);
+    return 0;
+}
+
+// Initialize dotgraphs and their fit functions. suffix is appended to the function names so that
+//     several sets can coexist.
+int init_sf_fits(TGraphErrors *dotgraph[SF_NCALS][NSECTORS], TF1 *polyfit[SF_NCALS][NSECTORS],
+                 const char *suffix) {
+    int ci = -1;
+    for (const char *cal : SFARR2D) {
+        ci++;
+        for (int si = 0; si < NSECTORS; ++si) {
+            // Initialize dotgraphs.
+            dotgraph[ci][si] = new TGraphErrors();
+            dotgraph[ci][si]->SetMarkerStyle(kFullCircle);
+            dotgraph[ci][si]->SetMarkerColor(kRed);
+
+            // Initialize fits.
+            char name[128];
+            snprintf(name, sizeof(name), "%s%d)%s", cal, si+1, suffix);
+            polyfit[ci][si] = new TF1(name,
+                    "[0]*([1]+[2]/x + [3]/(x*x))", SF_PMIN+SF_PSTEP, SF_PMAX-SF_PSTEP);
+                    // "[0]+[1]*x+[2]*x*x+[3]*x*x*x", SF_PMIN+SF_PSTEP, SF_PMAX-SF_PSTEP);
+            polyfit[ci][si]->SetParameter(0 /* p0 */, 0.25);
+            polyfit[ci][si]->SetParameter(1 /* p1 */, 1);
+            polyfit[ci][si]->SetParameter(2 /* p2 */, 0);
+            polyfit[ci][si]->SetParameter(3 /* p3 */, 0);
+        }
+    }
+
+    return 0;
+}
+
+// Fit the sampling fraction histograms in h, and save the results to
+//     `../root_io/sf_study_%06d.root` and `../data/sf_params_%06d.txt`. If fast_fit is set, Minuit
+//     is only used for the pairs of (calorimeter, sector) where the fast fits fail. If cmp_fits is
+//     set, both methods are run and their results compared.
+int fit_and_save_sf(sf_histos *h, int run_no, bool fast_fit, bool cmp_fits, int nthreads,
+                    const sf_seeds *seeds) {
+    gStyle->SetOptFit();
+
+    const int ncals = SF_NCALS;
+    TGraphErrors *sf_dotgraph[ncals][NSECTORS];
+    TF1 *sf_polyfit[ncals][NSECTORS];
+    double sf_fitresults[ncals][NSECTORS][SF_NPARAMS][2];
+    init_sf_fits(sf_dotgraph, sf_polyfit, "");
+    TH1 *slices[SF_NCALS][NSECTORS][SF_NPBINS];
+    project_sf_slices(h, slices);
+    struct timespec t0, t1;
+
+    // Fit histograms.
+    bool use_minuit[SF_NCALS][NSECTORS];
+    bool fast_failed[SF_NCALS][NSECTORS];
+    double fast_s   = 0;
+    double minuit_s = 0;
+    for (int ci = 0; ci < ncals; ++ci) {
+        for (int si = 0; si < NSECTORS; ++si) use_minuit[ci][si] = true;
+    }
+    if (fast_fit) {
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        int nfailed = fit_sf_fast(h, slices, sf_dotgraph, sf_polyfit, sf_fitresults, use_minuit);
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        fast_s = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec)*1e-9;
+        if (nfailed > 0) printf("Fast fits failed for %d sectors, using Minuit.\n", nfailed);
+        memcpy(fast_failed, use_minuit, sizeof(fast_failed));
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    sf_fitstats stats;
+    memset(&stats, 0, sizeof(stats));
+    fit_sf(slices, sf_dotgraph, sf_polyfit, sf_fitresults, use_minuit, nthreads, seeds, &stats);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    minuit_s = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec)*1e-9;
+
+    // Run the other method too and compare their results.
+    if (cmp_fits) {
+        TGraphErrors *cmp_dotgraph[ncals][NSECTORS];
+        TF1 *cmp_polyfit[ncals][NSECTORS];
+        double cmp_fitresults[ncals][NSECTORS][SF_NPARAMS][2];
+        init_sf_fits(cmp_dotgraph, cmp_polyfit, " cmp");
+
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        if (fast_fit) {
+            bool all[SF_NCALS][NSECTORS];
+            for (int ci = 0; ci < ncals; ++ci) {
+                for (int si = 0; si < NSECTORS; ++si) all[ci][si] = true;
+            }
+            memset(&stats, 0, sizeof(stats)); // Report the full Minuit fits, as with its time.
+            fit_sf(slices, cmp_dotgraph, cmp_polyfit, cmp_fitresults, all, nthreads, seeds,
+                   &stats);
+        }
+        else {
+            fit_sf_fast(h, slices, cmp_dotgraph, cmp_polyfit, cmp_fitresults, fast_failed);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        double cmp_s = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec)*1e-9;
+
+        if (fast_fit) {
+            minuit_s = cmp_s;
+            print_sf_comparison(sf_fitresults, cmp_fitresults, fast_failed);
+        }
+        else {
+            fast_s = cmp_s;
+            print_sf_comparison(cmp_fitresults, sf_fitresults, fast_failed);
+        }
+    }
+    if (fast_fit || cmp_fits) printf("Fast fits: %.3f s. ", fast_s);
+    printf("Minuit fits: %.3f s.\n", minuit_s);
+    if (stats.bin_fits > 0) print_sf_fitstats(&stats);
+
+    // Create output file.
+    char*  out_filename = (char *) malloc(128 * sizeof(char));
+    sprintf(out_filename, "../root_io/sf_study_%06d.root", run_no);
+    
+    TFile *f_out = TFile::Open(out_filename, "RECREATE");
+    // Write to output file.
+    TString dir;
+    TCanvas *gcvs = new TCanvas();
+    for (int ci = 0; ci < ncals; ++ci) {
+        dir = Form("%s", CALNAME[ci]);
+        f_out->mkdir(dir);
+        f_out->cd(dir);
+        for (int si = 0; si < NSECTORS; ++si) {
+            dir = Form("%s/sector %d", CALNAME[ci], si+1);
+            f_out->mkdir(dir);
+            f_out->cd(dir);
+
+            h->histos.histos[h->sf2D_h[ci][si]]->Draw("colz");
+            sf_dotgraph[ci][si]->Draw("Psame");
+            sf_polyfit[ci][si]->Draw("same");
+            gcvs->Write(Form("%s%d)", SFARR2D[ci], si+1));
+            for (int pi = 0; pi < SF_NPBINS; ++pi) slices[ci][si][pi]->Write();
+        }
+    }
+
+    // Write results to file.
+    FILE *t_out = fopen(Form("../data/sf_params_%06d.txt", run_no), "w");
+
+    if (t_out == NULL) return 4;
+    for (int ci = 3; ci < 4; ++ci) { // NOTE. Only writing ECAL sf results.
+        for (int si = 0; si < NSECTORS; ++si) {
+            for (int ppi = 0; ppi < 2; ++ppi) { // sf and sfs.
+                for (int pi = 0; pi < SF_NPARAMS; ++pi) {
+                    fprintf(t_out, "%011.8f ", sf_fitresults[ci][si][pi][0]);
+                }
+            }
+            fprintf(t_out, "\n");
+        }
+    }
+
+    fclose(t_out);
+    f_out->Close();
+    free_sf_slices(slices);
+    free(out_filename);
+
+    return 0;
+}
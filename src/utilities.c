@@ -11,43 +11,9 @@
 //
 // You can see a copy of the GNU Lesser Public License under the LICENSE file.
 
-#include "../lib/utilities.h"
-
-// Pass from radians to degrees.
-double to_deg(double radians) {
-    return radians * (180.0 / M_PI);
-}
-
-// Compute a 2D vector's magnitude from its components.
-double calc_magnitude(double x, double y) {
-    return sqrt(x*x + y*y);
-}
-
-// Compute a 3D vector's magnitude from its components.
-double calc_magnitude(double x, double y, double z) {
-    return sqrt(x*x + y*y + z*z);
-}
+#include <algorithm>
 
-// Get angle between two vectors.
-double calc_angle(double x1, double y1, double z1, double x2, double y2, double z2) {
-    return acos((x1*x2 + y1*y2 + z1*z2)/(calc_magnitude(x1,y1,z1) * calc_magnitude(x2,y2,z2)));
-}
-
-// Rotate a vector around the y axis by theta.
-void rotate_y(double *x, double *z, double th) {
-    double x_prev = *x;
-    double z_prev = *z;
-    *x =  x_prev*cos(th) + z_prev*sin(th);
-    *z = -x_prev*sin(th) + z_prev*cos(th);
-}
-
-// Rotate a vector around the z axis by theta.
-void rotate_z(double *x, double *y, double th) {
-    double x_prev = *x;
-    double y_prev = *y;
-    *x = x_prev*cos(th) - y_prev*sin(th);
-    *y = x_prev*sin(th) + y_prev*cos(th);
-}
+#include "../lib/utilities.h"
 
 // Catch a y or n input.
 bool catch_yn() {
@@ -77,6 +43,24 @@ int catch_string(const char * list[], int size) {
     return x;
 }
 
+// Catch a full line from stdin, skipping any whitespace before it.
+int catch_line(char * str, int size) {
+    char format[32];
+    sprintf(format, " %%%d[^\n]", size - 1);
+    while (true) {
+        printf(">>> ");
+        if (scanf(format, str) == 1) break;
+    }
+
+    return 0;
+}
+
+// Find a string within a list, returning its index or -1 if it's not there.
+int find_string(const char * list[], int size, const char * str) {
+    for (int i = 0; i < size; ++i) if (!strcmp(str, list[i])) return i;
+    return -1;
+}
+
 // Catch a long value from stdin.
 long catch_long() {
     long r;
@@ -109,20 +93,121 @@ double catch_double() {
     return r;
 }
 
-// Insert a 1-dimensional histogram of floating point numbers into a map.
-int insert_TH1F(std::map<const char *, TH1 *> *map, const char *k, const char *n, const char *xn,
-               int bins, double min, double max) {
-    map->insert(std::pair<const char *, TH1 *>
-            (n, new TH1F(Form("%s: %s", k, n), Form("%s;%s", n, xn), bins, min, max)));
+// Book a 1-dimensional histogram of floating point numbers in a registry, returning its handle.
+int book_TH1F(histo_registry *r, const char *k, const char *n, const char *xn,
+              int bins, double min, double max) {
+    r->histos.push_back(new TH1F(Form("%s: %s", k, n), Form("%s;%s", n, xn), bins, min, max));
+    return r->histos.size() - 1;
+}
+
+// Book a 2-dimensional histogram of floating point numbers in a registry, returning its handle.
+int book_TH2F(histo_registry *r, const char *k, const char *n, const char *nx, const char *ny,
+              int xbins, double xmin, double xmax, int ybins, double ymin, double ymax) {
+    r->histos.push_back(new TH2F(Form("%s: %s", k, n), Form("%s;%s;%s", n, nx, ny),
+                                 xbins, xmin, xmax, ybins, ymin, ymax));
+    return r->histos.size() - 1;
+}
+
+// Get the 64-bit key of event evn from run run_no. Returns 1 if either doesn't fit in its field of
+//     the key, which would corrupt the other.
+int evn_key(int run_no, long long evn, long long * key) {
+    if (run_no < 0 || run_no >= (1LL << (63 - EVNKEY_BITS))) return 1;
+    if (evn    < 0 || evn    >= (1LL << EVNKEY_BITS))        return 1;
+    * key = ((long long) run_no << EVNKEY_BITS) | evn;
     return 0;
 }
 
-// Insert a 2-dimensional histogram of floating point numbers into a map.
-int insert_TH2F(std::map<const char *, TH1 *> *map, const char *k,
-                const char *n, const char *nx, const char *ny,
-                int xbins, double xmin, double xmax, int ybins, double ymin, double ymax) {
-    map->insert(std::pair<const char *, TH1 *>
-            (n, new TH2F(Form("%s: %s", k, n), Form("%s;%s;%s", n, nx, ny),
-                         xbins, xmin, xmax, ybins, ymin, ymax)));
+// Get the run number of a key.
+int evn_key_run(long long key) {
+    return (int) (key >> EVNKEY_BITS);
+}
+
+// Get the event number of a key.
+long long evn_key_evn(long long key) {
+    return key & ((1LL << EVNKEY_BITS) - 1);
+}
+
+// Grow a bitset so that it covers words first_word to last_word, counting from event 0. Like the
+//     end of the bitset, its start grows geometrically so that adding events in descending order
+//     doesn't move all words each time.
+int evn_bitset_cover(evn_bitset *b, long long first_word, long long last_word) {
+    if (b->words.empty()) {
+        b->first = first_word * 64;
+        b->words.resize(last_word - first_word + 1, 0);
+        return 0;
+    }
+    long long b_first = b->first / 64;
+    if (first_word < b_first) {
+        long long grow = std::min(std::max(b_first - first_word, (long long) b->words.size()),
+                                  b_first);
+        b->words.insert(b->words.begin(), grow, 0);
+        b_first -= grow;
+        b->first = b_first * 64;
+    }
+    if (last_word - b_first >= (long long) b->words.size()) {
+        b->words.resize(last_word - b_first + 1, 0);
+    }
     return 0;
 }
+
+// Mark an event as selected or not selected.
+int evn_selection_set(evn_selection *s, long long key, bool selected) {
+    long long evn = evn_key_evn(key);
+    std::map<int, evn_bitset>::iterator it = s->runs.find(evn_key_run(key));
+    if (it == s->runs.end()) {
+        if (!selected) return 0;
+        it = s->runs.insert({evn_key_run(key), {0, {}}}).first;
+    }
+    evn_bitset *b = &(it->second);
+    if (b->words.empty() || evn < b->first || evn - b->first >= 64 * (long long) b->words.size()) {
+        if (!selected) return 0;
+        evn_bitset_cover(b, evn/64, evn/64);
+    }
+
+    long long i = evn - b->first;
+    if (selected) b->words[i/64] |=  (1ULL << (i%64));
+    else          b->words[i/64] &= ~(1ULL << (i%64));
+    return 0;
+}
+
+// Check if an event is selected.
+bool evn_selection_get(const evn_selection *s, long long key) {
+    std::map<int, evn_bitset>::const_iterator it = s->runs.find(evn_key_run(key));
+    if (it == s->runs.end()) return false;
+    const evn_bitset *b = &(it->second);
+    long long i = evn_key_evn(key) - b->first;
+    if (i < 0 || i >= 64 * (long long) b->words.size()) return false;
+    return (b->words[i/64] >> (i%64)) & 1ULL;
+}
+
+// Add the events selected in src to dst.
+int evn_selection_merge(evn_selection *dst, const evn_selection *src) {
+    for (const std::pair<const int, evn_bitset> &run : src->runs) {
+        const evn_bitset *sb = &(run.second);
+        if (sb->words.empty()) continue;
+        evn_bitset *db    = &(dst->runs[run.first]);
+        long long   first = sb->first / 64;
+        evn_bitset_cover(db, first, first + sb->words.size() - 1);
+        uint64_t *dw = &(db->words[first - db->first/64]);
+        for (UInt_t wi = 0; wi < sb->words.size(); ++wi) dw[wi] |= sb->words[wi];
+    }
+    return 0;
+}
+
+// Count the events of run run_no in a selection.
+long evn_selection_count(const evn_selection *s, int run_no) {
+    std::map<int, evn_bitset>::const_iterator it = s->runs.find(run_no);
+    if (it == s->runs.end()) return 0;
+    long n = 0;
+    for (uint64_t w : it->second.words) n += __builtin_popcountll(w);
+    return n;
+}
+
+// Get the memory used by the bitsets of a selection.
+long evn_selection_bytes(const evn_selection *s) {
+    long bytes = 0;
+    for (const std::pair<const int, evn_bitset> &run : s->runs) {
+        bytes += run.second.words.capacity() * sizeof(uint64_t);
+    }
+    return bytes;
+}